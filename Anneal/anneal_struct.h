@@ -0,0 +1,84 @@
+/*
+ * The Data Structures use in the local search
+ * (simulated annealing / tabu) encoding
+ *
+ */
+
+#include <pthread.h>
+
+// cost functions
+#define ANNEAL_AVERAGE  0  // total switching weighted by transition probability
+#define ANNEAL_PEAK     1  // peak switching, then transitions at the peak
+
+// search methods
+#define ANNEAL_SA       0  // simulated annealing
+#define ANNEAL_TABU     1  // tabu search
+
+#define ANNEAL_MAX_CODE_LENGTH  24
+#define ANNEAL_CHECK_PERIOD     256  // moves between two looks at the clock
+#define ANNEAL_SAMPLE           200  // moves sampled for the initial temperature
+#define ANNEAL_FINAL_RATIO      1.0e-4  // final over initial temperature
+#define ANNEAL_TABU_CANDIDATE   32  // moves tried per tabu iteration
+#define ANNEAL_TABU_TENURE      7
+
+/**********************************
+options of the search
+**********************************/
+typedef struct anneal_param_struct {
+  int cost;            // ANNEAL_AVERAGE or ANNEAL_PEAK
+  int method;          // ANNEAL_SA or ANNEAL_TABU
+  double time_limit;   // wall clock seconds for all the restarts
+  long max_move;       // moves per restart, 0 for no limit
+  unsigned long seed;
+  int num_restart;
+  int num_thread;      // 0 for one per processor
+} anneal_param_t;
+
+/**********************************
+the STG seen by the search, shared
+read only by all the restarts
+**********************************/
+typedef struct anneal_graph_struct {
+  int num_state;
+  int code_length;
+  int num_code;        // 2^code_length
+  int num_trans;       // transitions between different states
+  int *adj_ptr;        // neighbors of state i are adj_state[adj_ptr[i]..adj_ptr[i+1])
+  int *adj_state;
+  double *adj_weight;  // total transition probability i->j plus j->i
+  int *adj_count;      // number of transitions i->j and j->i
+  int *init_code;      // POW3 code of each state
+} anneal_graph_t;
+
+/**********************************
+one restart of the search
+**********************************/
+typedef struct anneal_search_struct {
+  int id;
+  anneal_graph_t *graph;
+  anneal_param_t *param;
+  double time_limit;   // seconds for this restart
+  uint64_t rng;
+  int *code;           // code of each state
+  int *code_state;     // state holding each code, UNDEFINE if free
+  double average;      // sum of weight * HAMMING distance
+  int *peak_count;     // number of transitions per peak switching
+  int peak;
+  double cost;
+  int *best_code;
+  double best_cost;
+  long *tabu_until;    // iteration until which a state may not move
+  long num_move;
+  long num_accept;
+  long num_improve;
+} anneal_search_t;
+
+/**********************************
+restarts handed out to the threads
+in order
+**********************************/
+typedef struct anneal_pool_struct {
+  anneal_search_t *search;
+  int num_restart;
+  int next_restart;
+} anneal_pool_t;
@@ -0,0 +1 @@
+../fsmToVerilog/context.h
\ No newline at end of file
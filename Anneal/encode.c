@@ -0,0 +1,577 @@
+/*
+ *
+ * Lin Yuan
+ * University of Maryland, College Park
+ *
+ * Local search FSM state encoding, between the greedy
+ * POW3 encoding and the exact brute force encoding.
+ * The search starts from the POW3 codes and moves one
+ * state to the code one bit away from its own, or
+ * swaps the codes of two states. Moving to a code held
+ * by another state swaps the two.
+ *
+ * A move only changes the transitions of the one or
+ * two states it touches, so it is scored in O(deg):
+ * the average cost is the sum of the total transition
+ * probability times the HAMMING distance of the codes,
+ * the peak cost is the peak switching (bits rising or
+ * falling on one transition) kept as a count of
+ * transitions per switching value, ties broken by the
+ * number of transitions at the peak.
+ *
+ * The moves are accepted by simulated annealing with
+ * a geometric cooling over the time budget, or chosen
+ * by tabu search among a sample of moves. Independent
+ * restarts with their own random seeds run in parallel
+ * and the best encoding wins.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "struct.h"
+#include "global.h"
+#include "context.h"
+#include "fsm.h"
+#include "matrix_util.h"
+#include "anneal_struct.h"
+
+extern boolean encode_pow3(fsm_t *fsm);
+extern csr_matrix_t *get_trans_prob_csr(fsm_t *fsm);
+extern boolean get_state_adjacency(fsm_t *fsm, int **adj_ptr, int **adj_state, int **adj_count);
+void evaluate_codes(anneal_search_t *search);
+void free_graph(anneal_graph_t *graph);
+
+/**************************************************
+xorshift64* random numbers, one stream per restart
+***************************************************/
+uint64_t next_random(anneal_search_t *search)
+{
+  search->rng ^= search->rng >> 12;
+  search->rng ^= search->rng << 25;
+  search->rng ^= search->rng >> 27;
+  return search->rng * 2685821657736338717ULL;
+}
+
+int random_int(anneal_search_t *search, int n)
+{
+  return (int)(next_random(search) % (uint64_t)n);
+}
+
+double random_real(anneal_search_t *search)
+{
+  return (next_random(search) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**************************************************
+build the STG of the search: the neighbors of every
+state with the number of transitions and the total
+transition probability between them, both ways.
+self loops never switch and are left out
+***************************************************/
+anneal_graph_t *build_graph(fsm_t *fsm, int cost)
+{
+  int i, j, k;
+  int num_adj;
+  int n = fsm->num_state;
+  int *pos = NULL;
+  anneal_graph_t *graph = NULL;
+  csr_matrix_t *trans_prob = NULL;
+  csr_matrix_t *trans_prob_t = NULL;
+
+  graph = (anneal_graph_t *)calloc(1, sizeof(anneal_graph_t));
+  graph->num_state = n;
+  graph->code_length = fsm->code_length;
+  graph->num_code = 1 << fsm->code_length;
+  graph->init_code = (int *)calloc(n, sizeof(int));
+
+  if(get_state_adjacency(fsm, &graph->adj_ptr, &graph->adj_state, &graph->adj_count) == FALSE) {
+    free_graph(graph);
+    return NULL;
+  }
+  num_adj = graph->adj_ptr[n];
+  graph->adj_weight = (double *)calloc(num_adj + 1, sizeof(double));
+  pos = (int *)malloc((n + 1) * sizeof(int));
+  for(i = 0; i < n; i++)
+    pos[i] = UNDEFINE;
+  for(k = 0; k < num_adj; k++)
+    graph->num_trans += graph->adj_count[k];
+  // every transition is counted at both of its ends
+  graph->num_trans /= 2;
+
+  // the peak cost does not need the probabilities
+  if(cost == ANNEAL_PEAK) {
+    free(pos);
+    return graph;
+  }
+
+  if((trans_prob = get_trans_prob_csr(fsm)) == NULL) {
+    free(pos);
+    free_graph(graph);
+    return NULL;
+  }
+  if((trans_prob_t = csr_transpose(trans_prob)) == NULL) {
+    free(pos);
+    free_csr_matrix(trans_prob);
+    free_graph(graph);
+    return NULL;
+  }
+
+  for(i = 0; i < n; i++) {
+    for(k = graph->adj_ptr[i]; k < graph->adj_ptr[i + 1]; k++)
+      pos[graph->adj_state[k]] = k;
+
+    for(k = trans_prob->row_ptr[i]; k < trans_prob->row_ptr[i + 1]; k++) {
+      j = trans_prob->col_idx[k];
+      if(j != i && pos[j] != UNDEFINE)
+	graph->adj_weight[pos[j]] += trans_prob->val[k];
+    }
+    for(k = trans_prob_t->row_ptr[i]; k < trans_prob_t->row_ptr[i + 1]; k++) {
+      j = trans_prob_t->col_idx[k];
+      if(j != i && pos[j] != UNDEFINE)
+	graph->adj_weight[pos[j]] += trans_prob_t->val[k];
+    }
+
+    for(k = graph->adj_ptr[i]; k < graph->adj_ptr[i + 1]; k++)
+      pos[graph->adj_state[k]] = UNDEFINE;
+  }
+
+  free(pos);
+  free_csr_matrix(trans_prob);
+  free_csr_matrix(trans_prob_t);
+
+  return graph;
+}
+
+void free_graph(anneal_graph_t *graph)
+{
+  pow3_free(graph->adj_ptr);
+  pow3_free(graph->adj_state);
+  pow3_free(graph->adj_count);
+  free(graph->adj_weight);
+  free(graph->init_code);
+  free(graph);
+}
+
+/**************************************************
+switching of a transition between two codes for
+the peak cost: the larger of the bits rising and
+the bits falling
+***************************************************/
+int get_trans_switch(int a, int b)
+{
+  uint64_t a_bits = (unsigned)a;
+  uint64_t b_bits = (unsigned)b;
+
+  return switch_bits(&a_bits, &b_bits, 1);
+}
+
+double get_cost(anneal_search_t *search)
+{
+  if(search->param->cost == ANNEAL_AVERAGE)
+    return search->average;
+
+  // fewer transitions at the peak is a step towards a lower peak
+  return (double)search->peak * (search->graph->num_trans + 1) + search->peak_count[search->peak];
+}
+
+/**************************************************
+update the cost for the code of state s changing
+from old_code to new_code. the transitions to the
+state skip are left alone: when two states swap
+codes, the switching between them does not change
+***************************************************/
+void move_edges(anneal_search_t *search, int s, int old_code, int new_code, int skip)
+{
+  anneal_graph_t *graph = search->graph;
+  int k, u;
+  int old_switch, new_switch;
+
+  for(k = graph->adj_ptr[s]; k < graph->adj_ptr[s + 1]; k++) {
+    u = graph->adj_state[k];
+    if(u == skip)
+      continue;
+
+    if(search->param->cost == ANNEAL_AVERAGE) {
+      search->average += graph->adj_weight[k] * (POPCOUNT((unsigned)(new_code ^ search->code[u])) - POPCOUNT((unsigned)(old_code ^ search->code[u])));
+    }
+    else {
+      old_switch = get_trans_switch(old_code, search->code[u]);
+      new_switch = get_trans_switch(new_code, search->code[u]);
+      search->peak_count[old_switch] -= graph->adj_count[k];
+      search->peak_count[new_switch] += graph->adj_count[k];
+      if(new_switch > search->peak)
+	search->peak = new_switch;
+    }
+  }
+}
+
+/**************************************************
+give new_code to state s, swapping with the state
+which holds it, if any. applying the move again
+with the old code of s undoes it
+***************************************************/
+void apply_move(anneal_search_t *search, int s, int new_code)
+{
+  int old_code = search->code[s];
+  int t = search->code_state[new_code];
+
+  move_edges(search, s, old_code, new_code, t);
+  if(t != UNDEFINE)
+    move_edges(search, t, new_code, old_code, s);
+
+  search->code[s] = new_code;
+  search->code_state[new_code] = s;
+  search->code_state[old_code] = t;
+  if(t != UNDEFINE)
+    search->code[t] = old_code;
+
+  if(search->param->cost == ANNEAL_PEAK)
+    while(search->peak > 0 && search->peak_count[search->peak] == 0)
+      search->peak--;
+
+  search->cost = get_cost(search);
+}
+
+/**************************************************
+a random move: flip one bit of the code of a state,
+or swap the codes of two states
+***************************************************/
+void random_move(anneal_search_t *search, int *s, int *new_code)
+{
+  int n = search->graph->num_state;
+  int t;
+
+  *s = random_int(search, n);
+  if(random_int(search, 2)) {
+    t = random_int(search, n - 1);
+    if(t >= *s)
+      t++;
+    *new_code = search->code[t];
+  }
+  else
+    *new_code = search->code[*s] ^ (1 << random_int(search, search->graph->code_length));
+}
+
+/**************************************************
+cost of the current codes from scratch
+***************************************************/
+void evaluate_codes(anneal_search_t *search)
+{
+  anneal_graph_t *graph = search->graph;
+  int i, k, u, v;
+
+  search->average = 0;
+  search->peak = 0;
+  memset(search->peak_count, 0, (graph->code_length + 1) * sizeof(int));
+
+  for(i = 0; i < graph->num_state; i++) {
+    for(k = graph->adj_ptr[i]; k < graph->adj_ptr[i + 1]; k++) {
+      u = graph->adj_state[k];
+      if(u < i)
+	continue;
+      search->average += graph->adj_weight[k] * POPCOUNT((unsigned)(search->code[i] ^ search->code[u]));
+      v = get_trans_switch(search->code[i], search->code[u]);
+      search->peak_count[v] += graph->adj_count[k];
+      if(v > search->peak)
+	search->peak = v;
+    }
+  }
+
+  search->cost = get_cost(search);
+}
+
+void load_codes(anneal_search_t *search, int *code)
+{
+  int i;
+
+  for(i = 0; i < search->graph->num_code; i++)
+    search->code_state[i] = UNDEFINE;
+  for(i = 0; i < search->graph->num_state; i++) {
+    search->code[i] = code[i];
+    search->code_state[code[i]] = i;
+  }
+  evaluate_codes(search);
+}
+
+void save_best(anneal_search_t *search)
+{
+  memcpy(search->best_code, search->code, search->graph->num_state * sizeof(int));
+  search->best_cost = search->cost;
+  search->num_improve++;
+}
+
+void init_search(anneal_search_t *search, anneal_graph_t *graph, anneal_param_t *param, int id)
+{
+  search->id = id;
+  search->graph = graph;
+  search->param = param;
+  search->rng = (param->seed + 1) * 0x9E3779B97F4A7C15ULL + (uint64_t)id * 0xBF58476D1CE4E5B9ULL;
+  if(search->rng == 0)
+    search->rng = 1;
+  search->code = (int *)calloc(graph->num_state, sizeof(int));
+  search->code_state = (int *)calloc(graph->num_code, sizeof(int));
+  search->peak_count = (int *)calloc(graph->code_length + 1, sizeof(int));
+  search->best_code = (int *)calloc(graph->num_state, sizeof(int));
+  search->tabu_until = (long *)calloc(graph->num_state, sizeof(long));
+  search->num_move = 0;
+  search->num_accept = 0;
+  search->num_improve = 0;
+
+  load_codes(search, graph->init_code);
+  memcpy(search->best_code, search->code, graph->num_state * sizeof(int));
+  search->best_cost = search->cost;
+}
+
+void free_search(anneal_search_t *search)
+{
+  free(search->code);
+  free(search->code_state);
+  free(search->peak_count);
+  free(search->best_code);
+  free(search->tabu_until);
+}
+
+/**************************************************
+fraction of the budget of a restart used so far:
+its moves if a move limit is given, which makes
+the result depend on the seed only, else its time
+***************************************************/
+double get_progress(anneal_search_t *search, struct timespec *start_time)
+{
+  struct timespec now;
+
+  if(search->param->max_move > 0)
+    return (double)search->num_move / search->param->max_move;
+
+  if(search->time_limit <= 0)
+    return 1.0;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((now.tv_sec - start_time->tv_sec) + (now.tv_nsec - start_time->tv_nsec) / 1e9) / search->time_limit;
+}
+
+/**************************************************
+simulated annealing. the first temperature accepts
+an average uphill move half of the time, and it
+cools geometrically down to ANNEAL_FINAL_RATIO of
+that over the budget
+***************************************************/
+void anneal(anneal_search_t *search)
+{
+  int i, s, new_code, old_code;
+  int num_uphill = 0;
+  double delta, old_cost;
+  double sum_uphill = 0;
+  double init_temp, temp, progress;
+  struct timespec start_time;
+
+  for(i = 0; i < ANNEAL_SAMPLE; i++) {
+    random_move(search, &s, &new_code);
+    old_code = search->code[s];
+    old_cost = search->cost;
+    apply_move(search, s, new_code);
+    delta = search->cost - old_cost;
+    apply_move(search, s, old_code);
+    if(delta > 0) {
+      sum_uphill += delta;
+      num_uphill++;
+    }
+  }
+  init_temp = num_uphill > 0 ? sum_uphill / num_uphill / log(2.0) : 1.0;
+  temp = init_temp;
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for(;;) {
+    if(search->num_move % ANNEAL_CHECK_PERIOD == 0) {
+      if((progress = get_progress(search, &start_time)) >= 1.0)
+	break;
+      temp = init_temp * pow(ANNEAL_FINAL_RATIO, progress);
+    }
+
+    random_move(search, &s, &new_code);
+    old_code = search->code[s];
+    old_cost = search->cost;
+    apply_move(search, s, new_code);
+    search->num_move++;
+
+    delta = search->cost - old_cost;
+    if(delta <= 0 || random_real(search) < exp(-delta / temp)) {
+      search->num_accept++;
+      if(search->cost < search->best_cost - 1.0e-12)
+	save_best(search);
+    }
+    else
+      apply_move(search, s, old_code);
+  }
+}
+
+/**************************************************
+tabu search. every iteration takes the best of a
+sample of moves, except moves of the states moved
+in the last ANNEAL_TABU_TENURE iterations unless
+they beat the best encoding
+***************************************************/
+void tabu_search(anneal_search_t *search)
+{
+  int i, s, t, new_code, old_code;
+  int best_s, best_new_code;
+  long iter;
+  double best_move_cost;
+  boolean is_tabu;
+  struct timespec start_time;
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  for(iter = 1; get_progress(search, &start_time) < 1.0; iter++) {
+    best_s = UNDEFINE;
+    best_new_code = UNDEFINE;
+    best_move_cost = 0;
+
+    for(i = 0; i < ANNEAL_TABU_CANDIDATE; i++) {
+      random_move(search, &s, &new_code);
+      t = search->code_state[new_code];
+      old_code = search->code[s];
+      apply_move(search, s, new_code);
+      search->num_move++;
+
+      is_tabu = search->tabu_until[s] > iter || (t != UNDEFINE && search->tabu_until[t] > iter);
+      if(!(is_tabu && search->cost >= search->best_cost - 1.0e-12)) {
+	if(best_s == UNDEFINE || search->cost < best_move_cost) {
+	  best_s = s;
+	  best_new_code = new_code;
+	  best_move_cost = search->cost;
+	}
+      }
+      apply_move(search, s, old_code);
+    }
+
+    if(best_s == UNDEFINE)
+      continue;
+
+    t = search->code_state[best_new_code];
+    apply_move(search, best_s, best_new_code);
+    search->num_accept++;
+    search->tabu_until[best_s] = iter + ANNEAL_TABU_TENURE;
+    if(t != UNDEFINE)
+      search->tabu_until[t] = iter + ANNEAL_TABU_TENURE;
+
+    if(search->cost < search->best_cost - 1.0e-12)
+      save_best(search);
+  }
+}
+
+void *anneal_worker(void *arg)
+{
+  anneal_pool_t *pool = (anneal_pool_t *)arg;
+  anneal_search_t *search = NULL;
+  int r;
+
+  while((r = __atomic_fetch_add(&pool->next_restart, 1, __ATOMIC_RELAXED)) < pool->num_restart) {
+    search = &pool->search[r];
+    if(search->param->method == ANNEAL_TABU)
+      tabu_search(search);
+    else
+      anneal(search);
+  }
+
+  return NULL;
+}
+
+void print_cost(char *title, anneal_search_t *search)
+{
+  if(search->param->cost == ANNEAL_AVERAGE)
+    printf("The %sswitching is %f\n", title, search->average);
+  else
+    printf("The %speak switch is %d, on %d transitions\n", title, search->peak, search->peak_count[search->peak]);
+}
+
+/***********************************************
+main engine for local search encoding
+***********************************************/
+boolean encode_anneal(fsm_t *fsm, anneal_param_t *param)
+{
+  int i, t;
+  int best;
+  int num_thread, num_round;
+  long num_move = 0, num_accept = 0, num_improve = 0;
+  anneal_graph_t *graph = NULL;
+  anneal_search_t *search = NULL;
+  anneal_pool_t pool;
+  pthread_t *thread = NULL;
+  struct timespec start_time, end_time;
+  boolean ret_flag;
+
+  if(encode_pow3(fsm) == FALSE) {
+    printf("ERROR: cannot get the POW3 encoding to start from.\n");
+    return FALSE;
+  }
+  if(fsm->num_state < 2 || fsm->code_length < 1)
+    return TRUE;
+  if(fsm->code_length > ANNEAL_MAX_CODE_LENGTH) {
+    printf("ERROR: code length %d is too long for local search encoding.\n", fsm->code_length);
+    return FALSE;
+  }
+
+  if((graph = build_graph(fsm, param->cost)) == NULL) {
+    printf("ERROR: cannot build STG.\n");
+    return FALSE;
+  }
+  get_fsm_code_vector(fsm, graph->init_code);
+
+  num_thread = param->num_thread > 0 ? param->num_thread : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if(num_thread < 1)
+    num_thread = 1;
+  if(param->num_restart < 1)
+    param->num_restart = num_thread;
+  if(num_thread > param->num_restart)
+    num_thread = param->num_restart;
+
+  // the restarts run in rounds of num_thread within the budget
+  num_round = (param->num_restart + num_thread - 1) / num_thread;
+  search = (anneal_search_t *)calloc(param->num_restart, sizeof(anneal_search_t));
+  for(i = 0; i < param->num_restart; i++) {
+    init_search(&search[i], graph, param, i);
+    search[i].time_limit = param->time_limit / num_round;
+  }
+  print_cost("initial ", &search[0]);
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+  pool.search = search;
+  pool.num_restart = param->num_restart;
+  pool.next_restart = 0;
+  thread = (pthread_t *)calloc(num_thread, sizeof(pthread_t));
+  for(t = 0; t < num_thread; t++)
+    pthread_create(&thread[t], NULL, anneal_worker, &pool);
+  for(t = 0; t < num_thread; t++)
+    pthread_join(thread[t], NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+  // the best restart, ties go to the first one
+  best = 0;
+  for(i = 0; i < param->num_restart; i++) {
+    num_move += search[i].num_move;
+    num_accept += search[i].num_accept;
+    num_improve += search[i].num_improve;
+    if(search[i].best_cost < search[best].best_cost)
+      best = i;
+  }
+
+  load_codes(&search[best], search[best].best_code);
+  print_cost("", &search[best]);
+  printf("Local search: %s, %d restarts on %d threads, best restart %d, %ld moves, %ld accepted, %ld improvements, %.2f seconds\n", param->method == ANNEAL_TABU ? "tabu" : "annealing", param->num_restart, num_thread, best, num_move, num_accept, num_improve, (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9);
+
+  ret_flag = set_fsm_code_vector(fsm, search[best].best_code);
+
+  for(i = 0; i < param->num_restart; i++)
+    free_search(&search[i]);
+  free(search);
+  free(thread);
+  free_graph(graph);
+
+  return ret_flag;
+}
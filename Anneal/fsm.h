@@ -0,0 +1 @@
+../fsmToVerilog/fsm.h
\ No newline at end of file
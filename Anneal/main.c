@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "struct.h"
+#include "global.h"
+#include "fsm.h"
+#include "anneal_struct.h"
+
+extern boolean write_fsm_to_blif_by_index(char *file_name, fsm_t *fsm);
+extern boolean encode_anneal(fsm_t *fsm, anneal_param_t *param);
+
+void print_usage(char *name)
+{
+  printf("Usage: %s [-peak] [-tabu] [-time seconds] [-moves n] [-seed n] [-restart n] [-t threads] [-input file | -prob file] <kiss2 file>\n", name);
+}
+
+int main(int argc, char **argv)
+{
+  fsm_t *fsm;
+  char *infile_name;
+  char *outfile_name;
+  char *temp_name;
+  char *input_name = NULL;
+  char *prob_name = NULL;
+  int i;
+  anneal_param_t param;
+
+  param.cost = ANNEAL_AVERAGE;
+  param.method = ANNEAL_SA;
+  param.time_limit = 5.0;
+  param.max_move = 0;
+  param.seed = 1;
+  param.num_restart = 0;
+  param.num_thread = 0;
+
+  for(i = 1; i < argc - 1; i++) {
+    if(!strcmp(argv[i], "-peak"))
+      param.cost = ANNEAL_PEAK;
+    else if(!strcmp(argv[i], "-tabu"))
+      param.method = ANNEAL_TABU;
+    else if(!strcmp(argv[i], "-time") && i < argc - 2)
+      param.time_limit = atof(argv[++i]);
+    else if(!strcmp(argv[i], "-moves") && i < argc - 2)
+      param.max_move = atol(argv[++i]);
+    else if(!strcmp(argv[i], "-seed") && i < argc - 2)
+      param.seed = strtoul(argv[++i], NULL, 10);
+    else if(!strcmp(argv[i], "-restart") && i < argc - 2)
+      param.num_restart = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-t") && i < argc - 2)
+      param.num_thread = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-input") && i < argc - 2)
+      input_name = argv[++i];
+    else if(!strcmp(argv[i], "-prob") && i < argc - 2)
+      prob_name = argv[++i];
+    else {
+      print_usage(argv[0]);
+      exit(1);
+    }
+  }
+  if(argc < 2) {
+    print_usage(argv[0]);
+    exit(1);
+  }
+  infile_name = argv[argc - 1];
+
+  fsm = init_fsm();
+
+  if(read_fsm_from_blif_mmap(infile_name, fsm) == FALSE) {
+    printf("ERROR: Unable to build FSM for %s.\n", fsm->name);
+    free_fsm(fsm);
+    exit(1);
+  }
+
+  if(input_name && read_input_prob(input_name, fsm) == FALSE) {
+    free_fsm(fsm);
+    exit(1);
+  }
+  set_fsm_prob_file(fsm, prob_name);
+
+  printf("Begin encoding for %s\n", fsm->name);  
+  if(encode_anneal(fsm, &param) == FALSE)
+    exit(1);
+
+  temp_name = get_name_without_suffix(infile_name, ".kiss2");
+  outfile_name = (char *)calloc(strlen(temp_name) + 6, sizeof(char));
+  sprintf(outfile_name, "%s.blif", temp_name);
+
+  write_fsm_to_blif_by_index(outfile_name, fsm);
+
+  free(temp_name);
+  free(outfile_name);
+  free_fsm(fsm);
+
+  return 0;
+}
@@ -0,0 +1 @@
+../POW3/pow3_struct.h
\ No newline at end of file
@@ -0,0 +1,43 @@
+/*
+ * The Data Structures use in the batch
+ * encoding of many FSMs
+ *
+ */
+
+#include <pthread.h>
+
+#define BATCH_CSV   0
+#define BATCH_JSON  1
+
+/**********************************
+one kiss2 file of the batch and
+what was measured on it
+**********************************/
+typedef struct batch_job_struct {
+  char *file_name;
+  char *fsm_name;
+  char *status;             // "ok" or what went wrong
+  int num_state;
+  int num_transition;
+  int num_input;
+  int num_output;
+  int code_length;
+  double switching_before;  // codes of the file, else state indices
+  double switching_after;   // POW3 codes
+  double read_time;         // seconds per phase
+  double prob_time;
+  double encode_time;
+  double score_time;
+} batch_job_t;
+
+/**********************************
+jobs handed out to the threads in
+order, each thread working on its
+own fsm_t
+**********************************/
+typedef struct batch_pool_struct {
+  batch_job_t *job;
+  int num_job;
+  int next_job;
+  boolean write_blif;       // write <name>.blif next to every input
+} batch_pool_t;
@@ -0,0 +1,410 @@
+/*
+ *
+ * Batch POW3 encoding of many kiss2 FSMs in one
+ * process. The inputs are kiss2 files, directories
+ * of kiss2 files, or list files with one path per
+ * line. The files are spread over a pool of threads,
+ * each reading, encoding and scoring its own fsm_t,
+ * and one CSV or JSON summary is written in the order
+ * of the inputs.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "struct.h"
+#include "global.h"
+#include "fsm.h"
+#include "matrix_util.h"
+#include "context.h"
+#include "batch_struct.h"
+
+extern boolean write_fsm_to_blif_by_index(char *file_name, fsm_t *fsm);
+extern boolean encode_pow3_with_prob(fsm_t *fsm, csr_matrix_t *trans_prob);
+extern csr_matrix_t *get_trans_prob_csr(fsm_t *fsm);
+extern double get_code_switching(fsm_t *fsm, csr_matrix_t *trans_prob);
+
+void print_usage(char *name)
+{
+  printf("Usage: %s [-t threads] [-json] [-blif] [-o summary] <kiss2 file | directory | list file> ...\n", name);
+}
+
+double get_elapsed(struct timespec *start_time)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start_time->tv_sec) + (now.tv_nsec - start_time->tv_nsec) / 1e9;
+}
+
+boolean has_suffix(char *name, char *suffix)
+{
+  int name_len = strlen(name);
+  int suffix_len = strlen(suffix);
+
+  return name_len >= suffix_len && !strcmp(name + name_len - suffix_len, suffix);
+}
+
+int compare_name(const void *a, const void *b)
+{
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/**********************************
+append a file to the batch
+**********************************/
+void add_job(batch_pool_t *pool, char *file_name)
+{
+  batch_job_t *job = NULL;
+
+  pool->job = (batch_job_t *)realloc(pool->job, (pool->num_job + 1) * sizeof(batch_job_t));
+  job = &pool->job[pool->num_job++];
+  memset(job, 0, sizeof(batch_job_t));
+  job->file_name = (char *)calloc(strlen(file_name) + 1, sizeof(char));
+  strcpy(job->file_name, file_name);
+  job->status = "not run";
+}
+
+/**********************************
+append the kiss2 files of a
+directory, sorted by name
+**********************************/
+boolean add_directory(batch_pool_t *pool, char *dir_name)
+{
+  DIR *dir = NULL;
+  struct dirent *entry = NULL;
+  char **name_list = NULL;
+  char *path = NULL;
+  int i, num_name = 0;
+
+  if((dir = opendir(dir_name)) == NULL) {
+    printf("ERROR: Cannot open directory %s\n", dir_name);
+    return FALSE;
+  }
+
+  while((entry = readdir(dir)) != NULL) {
+    if(!has_suffix(entry->d_name, ".kiss2"))
+      continue;
+    name_list = (char **)realloc(name_list, (num_name + 1) * sizeof(char *));
+    name_list[num_name] = (char *)calloc(strlen(entry->d_name) + 1, sizeof(char));
+    strcpy(name_list[num_name++], entry->d_name);
+  }
+  closedir(dir);
+
+  qsort(name_list, num_name, sizeof(char *), compare_name);
+  for(i = 0; i < num_name; i++) {
+    path = (char *)calloc(strlen(dir_name) + strlen(name_list[i]) + 2, sizeof(char));
+    sprintf(path, "%s/%s", dir_name, name_list[i]);
+    add_job(pool, path);
+    free(path);
+    free(name_list[i]);
+  }
+  free(name_list);
+
+  return TRUE;
+}
+
+/**********************************
+append the files of a list file,
+one path per line. empty lines and
+lines starting with # are skipped
+**********************************/
+boolean add_list(batch_pool_t *pool, char *list_name)
+{
+  FILE *fp = NULL;
+  char line[4096];
+  char *start, *end;
+
+  if((fp = fopen(list_name, "r")) == NULL) {
+    printf("ERROR: Cannot open list file %s\n", list_name);
+    return FALSE;
+  }
+
+  while(fgets(line, sizeof(line), fp) != NULL) {
+    for(start = line; *start == ' ' || *start == '\t'; start++)
+      ;
+    for(end = start + strlen(start); end > start && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'); end--)
+      ;
+    *end = '\0';
+    if(*start == '\0' || *start == '#')
+      continue;
+    add_job(pool, start);
+  }
+  fclose(fp);
+
+  return TRUE;
+}
+
+/**********************************
+give the states their index as the
+code when the file has no codes
+**********************************/
+void set_index_codes(fsm_t *fsm)
+{
+  int i, k;
+  char *code = NULL;
+
+  for(i = 0; i < fsm->num_state; i++)
+    if(fsm->state[i].code == NULL || (int)strlen(fsm->state[i].code) < fsm->code_length)
+      break;
+  if(i == fsm->num_state)
+    return;
+
+  code = (char *)calloc(fsm->code_length + 1, sizeof(char));
+  for(i = 0; i < fsm->num_state; i++) {
+    for(k = 0; k < fsm->code_length; k++)
+      code[k] = ((fsm->state[i].index >> k) & 1) ? '1' : '0';
+    set_state_code(fsm, &fsm->state[i], code);
+  }
+  free(code);
+
+  pack_fsm_codes(fsm);
+}
+
+/**********************************
+read, encode and score one file
+**********************************/
+void run_job(batch_job_t *job, boolean write_blif)
+{
+  fsm_t *fsm = NULL;
+  csr_matrix_t *trans_prob = NULL;
+  char *temp_name = NULL;
+  char *outfile_name = NULL;
+  struct timespec start_time;
+
+  fsm = init_fsm();
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  if(read_fsm_from_blif_mmap(job->file_name, fsm) == FALSE) {
+    job->status = "read failed";
+    goto failure;
+  }
+  job->read_time = get_elapsed(&start_time);
+
+  job->fsm_name = (char *)calloc(strlen(fsm->name) + 1, sizeof(char));
+  strcpy(job->fsm_name, fsm->name);
+  job->num_state = fsm->num_state;
+  job->num_transition = fsm->num_transition;
+  job->num_input = fsm->num_input;
+  job->num_output = fsm->num_output;
+  job->code_length = fsm->code_length;
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  if((trans_prob = get_trans_prob_csr(fsm)) == NULL) {
+    job->status = "no steady state";
+    goto failure;
+  }
+  job->prob_time = get_elapsed(&start_time);
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  set_index_codes(fsm);
+  job->switching_before = get_code_switching(fsm, trans_prob);
+  job->score_time = get_elapsed(&start_time);
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  if(encode_pow3_with_prob(fsm, trans_prob) == FALSE) {
+    job->status = "encode failed";
+    goto failure;
+  }
+  job->encode_time = get_elapsed(&start_time);
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  job->switching_after = get_code_switching(fsm, trans_prob);
+  job->score_time += get_elapsed(&start_time);
+
+  if(write_blif) {
+    temp_name = get_name_without_suffix(job->file_name, ".kiss2");
+    outfile_name = (char *)calloc(strlen(temp_name) + 6, sizeof(char));
+    sprintf(outfile_name, "%s.blif", temp_name);
+    if(write_fsm_to_blif_by_index(outfile_name, fsm) == FALSE) {
+      job->status = "write failed";
+      goto failure;
+    }
+  }
+
+  job->status = "ok";
+
+ failure:
+  if(trans_prob)
+    free_csr_matrix(trans_prob);
+  free(temp_name);
+  free(outfile_name);
+  free_fsm(fsm);
+}
+
+void *batch_worker(void *arg)
+{
+  batch_pool_t *pool = (batch_pool_t *)arg;
+  pow3_ctx_t *ctx, *prev;
+  int i;
+
+  // own context, the errors of a job are not seen by the others
+  if((ctx = new_context(NULL)) == NULL)
+    return NULL;
+  ctx->log = stdout;
+  ctx->quiet = FALSE;
+
+  while((i = __atomic_fetch_add(&pool->next_job, 1, __ATOMIC_RELAXED)) < pool->num_job) {
+    prev = enter_context(ctx);
+    run_job(&pool->job[i], pool->write_blif);
+    leave_context(prev);
+  }
+
+  free_context(ctx);
+  return NULL;
+}
+
+/**********************************
+print a string field, quoted for
+JSON, or for CSV when needed
+**********************************/
+void print_field(FILE *fp, char *str, int format)
+{
+  char *c;
+
+  if(str == NULL)
+    str = "";
+
+  if(format == BATCH_CSV && strpbrk(str, ",\"\n") == NULL) {
+    fprintf(fp, "%s", str);
+    return;
+  }
+
+  fputc('"', fp);
+  for(c = str; *c; c++) {
+    if(*c == '"')
+      fputs(format == BATCH_JSON ? "\\\"" : "\"\"", fp);
+    else if(*c == '\\' && format == BATCH_JSON)
+      fputs("\\\\", fp);
+    else
+      fputc(*c, fp);
+  }
+  fputc('"', fp);
+}
+
+void write_summary(FILE *fp, batch_pool_t *pool, int format)
+{
+  int i;
+  batch_job_t *job = NULL;
+
+  if(format == BATCH_CSV)
+    fprintf(fp, "file,name,states,transitions,inputs,outputs,code_length,switching_before,switching_after,read_sec,prob_sec,encode_sec,score_sec,status\n");
+  else
+    fprintf(fp, "[\n");
+
+  for(i = 0; i < pool->num_job; i++) {
+    job = &pool->job[i];
+    if(format == BATCH_CSV) {
+      print_field(fp, job->file_name, format);
+      fputc(',', fp);
+      print_field(fp, job->fsm_name, format);
+      fprintf(fp, ",%d,%d,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,", job->num_state, job->num_transition, job->num_input, job->num_output, job->code_length, job->switching_before, job->switching_after, job->read_time, job->prob_time, job->encode_time, job->score_time);
+      print_field(fp, job->status, format);
+      fputc('\n', fp);
+    }
+    else {
+      fprintf(fp, "  {\"file\": ");
+      print_field(fp, job->file_name, format);
+      fprintf(fp, ", \"name\": ");
+      print_field(fp, job->fsm_name, format);
+      fprintf(fp, ", \"states\": %d, \"transitions\": %d, \"inputs\": %d, \"outputs\": %d, \"code_length\": %d", job->num_state, job->num_transition, job->num_input, job->num_output, job->code_length);
+      fprintf(fp, ", \"switching_before\": %.6f, \"switching_after\": %.6f", job->switching_before, job->switching_after);
+      fprintf(fp, ", \"read_sec\": %.6f, \"prob_sec\": %.6f, \"encode_sec\": %.6f, \"score_sec\": %.6f, \"status\": ", job->read_time, job->prob_time, job->encode_time, job->score_time);
+      print_field(fp, job->status, format);
+      fprintf(fp, "}%s\n", i + 1 < pool->num_job ? "," : "");
+    }
+  }
+
+  if(format == BATCH_JSON)
+    fprintf(fp, "]\n");
+}
+
+int main(int argc, char **argv)
+{
+  int i, t;
+  int num_thread = 0;
+  int num_fail = 0;
+  int format = BATCH_CSV;
+  char *summary_name = NULL;
+  struct stat st;
+  struct timespec start_time;
+  batch_pool_t pool;
+  pthread_t *thread = NULL;
+  FILE *fp = NULL;
+
+  pool.job = NULL;
+  pool.num_job = 0;
+  pool.next_job = 0;
+  pool.write_blif = FALSE;
+
+  for(i = 1; i < argc; i++) {
+    if(!strcmp(argv[i], "-t") && i < argc - 1)
+      num_thread = atoi(argv[++i]);
+    else if(!strcmp(argv[i], "-json"))
+      format = BATCH_JSON;
+    else if(!strcmp(argv[i], "-blif"))
+      pool.write_blif = TRUE;
+    else if(!strcmp(argv[i], "-o") && i < argc - 1)
+      summary_name = argv[++i];
+    else if(argv[i][0] == '-') {
+      print_usage(argv[0]);
+      exit(1);
+    }
+    else if(stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+      if(add_directory(&pool, argv[i]) == FALSE)
+	exit(1);
+    }
+    else if(has_suffix(argv[i], ".kiss2"))
+      add_job(&pool, argv[i]);
+    else if(add_list(&pool, argv[i]) == FALSE)
+      exit(1);
+  }
+
+  if(pool.num_job == 0) {
+    print_usage(argv[0]);
+    exit(1);
+  }
+  if(summary_name == NULL)
+    summary_name = format == BATCH_JSON ? "summary.json" : "summary.csv";
+
+  if(num_thread < 1)
+    num_thread = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if(num_thread < 1)
+    num_thread = 1;
+  if(num_thread > pool.num_job)
+    num_thread = pool.num_job;
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+  thread = (pthread_t *)calloc(num_thread, sizeof(pthread_t));
+  for(t = 0; t < num_thread; t++)
+    pthread_create(&thread[t], NULL, batch_worker, &pool);
+  for(t = 0; t < num_thread; t++)
+    pthread_join(thread[t], NULL);
+
+  if((fp = fopen(summary_name, "w")) == NULL) {
+    printf("ERROR: Cannot open summary file %s\n", summary_name);
+    exit(1);
+  }
+  write_summary(fp, &pool, format);
+  fclose(fp);
+
+  for(i = 0; i < pool.num_job; i++) {
+    if(strcmp(pool.job[i].status, "ok"))
+      num_fail++;
+    free(pool.job[i].file_name);
+    free(pool.job[i].fsm_name);
+  }
+  printf("Encoded %d FSMs (%d failed) on %d threads in %.2f seconds, summary in %s\n", pool.num_job, num_fail, num_thread, get_elapsed(&start_time), summary_name);
+
+  free(pool.job);
+  free(thread);
+
+  return num_fail > 0 ? 1 : 0;
+}
@@ -0,0 +1 @@
+../fsmToVerilog/read_fsm.c
\ No newline at end of file
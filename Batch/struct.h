@@ -0,0 +1 @@
+../fsmToVerilog/struct.h
\ No newline at end of file
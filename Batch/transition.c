@@ -0,0 +1 @@
+../fsmSwitching/transition.c
\ No newline at end of file
@@ -0,0 +1,69 @@
+/*
+ * The Data Structures use in the brute force
+ * (branch and bound) encoding
+ *
+ */
+
+#include <pthread.h>
+
+// tasks cut from the search tree per worker
+#define BF_TASK_PER_THREAD  16
+
+/**********************************
+a subtree of the search: the codes
+of the first depth states in the
+search order
+**********************************/
+typedef struct bf_task_struct {
+  int depth;
+  int bound;        // peak switching of the prefix
+  int block_start;  // bit blocks after the prefix
+  int *prefix;      // code of the i-th state in the search order
+} bf_task_t;
+
+/**********************************
+double ended queue of task indices
+owned by one worker. the owner pops
+from the head, thieves take from
+the tail
+**********************************/
+typedef struct bf_deque_struct {
+  int head;
+  int tail;
+  int *task_list;
+  pthread_mutex_t lock;
+} bf_deque_t;
+
+/**********************************
+data shared by all the workers
+**********************************/
+typedef struct bf_shared_struct {
+  fsm_t *fsm;
+  int num_code;
+  int num_thread;
+  int *state_order;   // states in the order they are assigned
+  int *adj_ptr;       // neighbors of state i are adj_state[adj_ptr[i]..adj_ptr[i+1])
+  int *adj_state;
+  int num_task;
+  bf_task_t *task;
+  int *task_best;     // best code vector found by each task
+  bf_deque_t *deque;  // one per worker
+  uint64_t best_key;  // (peak << 32) | (task + 1), updated atomically
+} bf_shared_t;
+
+/**********************************
+search state private to one worker
+**********************************/
+typedef struct bf_search_struct {
+  int id;
+  int task_id;        // task being searched
+  bf_shared_t *shared;
+  int *code_vector;   // code of each state, UNDEFINE if not assigned
+  char *code_used;    // codes taken by the assigned states
+  int *block_start;   // per depth, bit i set if a bit block starts at i
+  long num_node;
+  long num_leaf;      // complete encodings reached
+  long num_bound_prune;
+  long num_sym_prune;
+  long num_improve;
+} bf_search_t;
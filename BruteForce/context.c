@@ -0,0 +1 @@
+../fsmToVerilog/context.c
\ No newline at end of file
@@ -0,0 +1 @@
+../fsmToVerilog/cube.c
\ No newline at end of file
@@ -3,167 +3,438 @@
  * Lin Yuan
  * University of Maryland, College Park
  *
- * Implementation of POW3 FSM state encoding
- * The transition probability is calculated 
- * by using Markov chain model.
+ * Exact FSM state encoding for minimum peak switching.
+ * The peak switching of an encoding is the largest
+ * number of state register bits rising (0->1) or
+ * falling (1->0) on any single state transition.
  *
- * Psuedo code of the POW3 algorithm refers to 
- * Luca Benini et al.'s State Assignment for Low Power Dissipation
- * in IEEE Journal of Solid-State Circuits 1995
+ * The search is a branch and bound over the states
+ * in a fixed order. A partial encoding is bounded by
+ * the peak switching of the transitions whose two
+ * states are already assigned, and is pruned once
+ * this bound reaches the best encoding found so far.
+ * The first incumbent is the POW3 encoding.
  *
- * This is a modified pow3 encode algorithm
- * It can be simply embedded to other program
- * 
+ * The top levels of the search tree are cut into
+ * tasks which are searched by a pool of workers, each
+ * owning a queue of tasks and stealing from the others
+ * when its own queue runs dry. The best peak switching
+ * is shared through one atomic key (peak, task) so that
+ * every worker prunes against the best so far, and ties
+ * go to the lowest task, which keeps the result the
+ * same for any number of workers.
  *
- * Update: removed a few bugs. It can process any large FSM benchmarks from kiss2
- * Update: use the fsm_t datastructure.
+ * The peak switching does not change if the code bits
+ * are permuted or all complemented, so only canonical
+ * encodings are enumerated: the bits which hold the
+ * same value in all states assigned so far form a
+ * block, and the next code must have its ones at the
+ * low end of every block. The first code has at most
+ * code_length/2 ones.
  *
  * Last modified May 4, 2009
  *
  */
- 
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include "struct.h"
 #include "global.h"
+#include "context.h"
+#include "fsm.h"
 #include "pow3_struct.h"
+#include "bf_struct.h"
 
-extern int hamming_distance(char *s1, char *s2, int n);
-extern double **get_trans_prob(fsm_t *fsm);
-void optimize_peak(int k, int n, int *output_vector, int *value_vector);
-extern fsm_t *get_fsm();
+extern boolean encode_pow3(fsm_t *fsm);
+extern boolean get_state_adjacency(fsm_t *fsm, int **adj_ptr, int **adj_state, int **adj_count);
+void optimize_peak(bf_search_t *search, int depth, int bound);
 
 // global variable
-int **l2h_switch_tbl;
-int **h2l_switch_tbl;
-int globalPeakSwitch;
-int *globalOptVector;
+int _bf_num_thread = 0;  // 0 means one worker per processor
 
-int vector_to_integer(int *vec, int n)
+/**************************************************
+peak switching of a transition between two codes:
+the larger of the bits rising (0->1) and the bits
+falling (1->0)
+***************************************************/
+int get_trans_switch(int cs_code_value, int ns_code_value)
+{
+  uint64_t cs_bits = (unsigned)cs_code_value;
+  uint64_t ns_bits = (unsigned)ns_code_value;
+
+  return switch_bits(&cs_bits, &ns_bits, 1);
+}
+
+int get_peak_switch(fsm_t *fsm, int *code_list)
 {
   int i;
-  int value;
-  value = 0;
-  for(i=0;i<n;i++)
-    value = value + (int)(vec[i]*pow(2,i));
-  return value;
-}
-
-int *integer_to_vector(int value, int n)
-{
-  int i,m;
-  int *vector;
-  vector = (int *)malloc(n * sizeof(int));
-  for(i=0; i<n; i++)
-    {
-      m = floor(value/pow(2,i));
-      if( m % 2 ==0)
-	vector[i]=0;
-      else
-	vector[i]=1;
+  int cs_id, ns_id;
+  int trans_switch, peak_switch;
+
+  peak_switch = 0;
+
+  for(i = 0; i < fsm->num_transition; i++) {
+    cs_id = (fsm->transition[i].current_state)->index;
+    ns_id = (fsm->transition[i].next_state)->index;
+    if((trans_switch = get_trans_switch(code_list[cs_id], code_list[ns_id])) > peak_switch)
+      peak_switch = trans_switch;
+  }
+
+  return peak_switch;
+}
+
+/**************************************************
+peak switching of the transitions between state s
+and the states assigned before it. this is what
+assigning s adds to the bound of the partial
+encoding, in O(deg(s))
+***************************************************/
+int get_partial_peak_switch(bf_search_t *search, int s)
+{
+  bf_shared_t *shared = search->shared;
+  int *code_vector = search->code_vector;
+  int k, t;
+  int trans_switch, peak_switch = 0;
+
+  for(k = shared->adj_ptr[s]; k < shared->adj_ptr[s + 1]; k++) {
+    t = shared->adj_state[k];
+    if(code_vector[t] == UNDEFINE)
+      continue;
+    if((trans_switch = get_trans_switch(code_vector[s], code_vector[t])) > peak_switch)
+      peak_switch = trans_switch;
+  }
+
+  return peak_switch;
+}
+
+/**************************************************
+order the states for the search: start from the
+state with most neighbors, then always take the
+state with most neighbors already ordered, so that
+the bound grows early
+***************************************************/
+void order_states(bf_shared_t *shared)
+{
+  fsm_t *fsm = shared->fsm;
+  int j, k;
+  int best;
+  int *link = (int *)calloc(fsm->num_state, sizeof(int));
+  char *ordered = (char *)calloc(fsm->num_state, sizeof(char));
+  int *degree = shared->adj_ptr;
+
+  for(k = 0; k < fsm->num_state; k++) {
+    best = UNDEFINE;
+    for(j = 0; j < fsm->num_state; j++) {
+      if(ordered[j])
+	continue;
+      if(best == UNDEFINE || link[j] > link[best] || (link[j] == link[best] && degree[j + 1] - degree[j] > degree[best + 1] - degree[best]))
+	best = j;
     }
-  return vector;
+    shared->state_order[k] = best;
+    ordered[best] = TRUE;
+
+    for(j = shared->adj_ptr[best]; j < shared->adj_ptr[best + 1]; j++)
+      link[shared->adj_state[j]]++;
+  }
+
+  free(link);
+  free(ordered);
 }
 
-void build_peak_switch_table(int num_state, int code_len)
+/**************************************************
+check that a code is canonical for the bit blocks
+in block_start: inside every block its ones must
+sit at the low end. return the blocks refined by
+the code, or UNDEFINE if it is not canonical
+***************************************************/
+int refine_blocks(int code, int block_start, int code_len)
 {
-  int i, j, k;
-  int max_num_state = pow(2, code_len);
-  int quo1, quo2;
-  int res1, res2;
+  int s, e;
+  int len, bits;
+  int new_start = block_start;
 
-  //Obtain switch look-up l2h__switch_tbl(0->1) and h2l_switch_tbl(1->0)
-  l2h_switch_tbl = (int **)malloc(max_num_state * sizeof(int *));
-  h2l_switch_tbl = (int **)malloc(max_num_state * sizeof(int *));
-  for(i = 0; i < max_num_state; i++) {
-    l2h_switch_tbl[i] = (int *)malloc(max_num_state * sizeof(int));
-    h2l_switch_tbl[i] = (int *)malloc(max_num_state * sizeof(int));
+  for(s = 0; s < code_len; s = e) {
+    for(e = s + 1; e < code_len && !((block_start >> e) & 1); e++)
+      ;
+    len = e - s;
+    bits = (code >> s) & ((1 << len) - 1);
+    // the ones of the block must be a run starting at s
+    if(bits & (bits + 1))
+      return UNDEFINE;
+    if(bits != 0 && bits != (1 << len) - 1)
+      new_start |= 1 << (s + POPCOUNT(bits));
   }
 
-  for(i = 0; i < max_num_state; i++) {
-    for(j = 0; j < max_num_state; j++) {
-      l2h_switch_tbl[i][j] = 0;
-      h2l_switch_tbl[i][j] = 0;
+  return new_start;
+}
+
+/**************************************************
+the blocks after giving code to the state at the
+given depth, UNDEFINE if the code is not canonical.
+the first code has at most code_length/2 ones, up
+to complement
+***************************************************/
+int canonical_blocks(bf_search_t *search, int depth, int code)
+{
+  int code_len = search->shared->fsm->code_length;
+
+  if(depth == 0 && 2 * POPCOUNT(code) > code_len)
+    return UNDEFINE;
+
+  return refine_blocks(code, search->block_start[depth], code_len);
+}
+
+/**************************************************
+a subtree with the given bound cannot improve on
+the best encoding: either its bound is larger, or
+equal and the best comes from an earlier task
+***************************************************/
+boolean is_pruned(bf_search_t *search, int bound)
+{
+  uint64_t key = ((uint64_t)bound << 32) | (uint64_t)(search->task_id + 1);
+
+  return key >= __atomic_load_n(&search->shared->best_key, __ATOMIC_ACQUIRE);
+}
+
+/**************************************************
+record a complete encoding with the given peak
+switching if it beats the best so far
+***************************************************/
+void update_best(bf_search_t *search, int peak_switch)
+{
+  bf_shared_t *shared = search->shared;
+  uint64_t key = ((uint64_t)peak_switch << 32) | (uint64_t)(search->task_id + 1);
+  uint64_t best = __atomic_load_n(&shared->best_key, __ATOMIC_ACQUIRE);
+
+  while(key < best) {
+    if(__atomic_compare_exchange_n(&shared->best_key, &best, key, FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+      memcpy(shared->task_best + (size_t)search->task_id * shared->fsm->num_state, search->code_vector, shared->fsm->num_state * sizeof(int));
+      search->num_improve++;
+      break;
     }
   }
+}
 
-  for(i = 0; i < max_num_state; i++) {
-    for(j = 0; j < max_num_state; j++) {
-      quo1 = i;
-      quo2 = j;
-      for(k = 0; k < code_len; k++) {
-	res1 = quo1%2;
-	quo1 = quo1/2;
-	res2 = quo2%2;
-	quo2 = quo2/2;
-	if(res1 < res2)
-	  l2h_switch_tbl[i][j]++;
-	else if(res1 > res2)
-	  h2l_switch_tbl[i][j]++;
-      }
+/**************************************************
+assign codes to the states from the depth-th one
+on in the search order, bound is the peak switching
+of the states assigned so far
+***************************************************/
+void optimize_peak(bf_search_t *search, int depth, int bound)
+{
+  bf_shared_t *shared = search->shared;
+  int s, code;
+  int new_bound, new_blocks;
+
+  search->num_node++;
+
+  if(depth == shared->fsm->num_state) {
+    // all states are assigned, the bound is the peak switching
+    search->num_leaf++;
+    update_best(search, bound);
+    return;
+  }
+
+  s = shared->state_order[depth];
+
+  for(code = 0; code < shared->num_code; code++) {
+    if(search->code_used[code])
+      continue;
+
+    if((new_blocks = canonical_blocks(search, depth, code)) == UNDEFINE) {
+      search->num_sym_prune++;
+      continue;
+    }
+
+    search->code_vector[s] = code;
+    new_bound = get_partial_peak_switch(search, s);
+    if(new_bound < bound)
+      new_bound = bound;
+
+    if(!is_pruned(search, new_bound)) {
+      search->code_used[code] = TRUE;
+      search->block_start[depth + 1] = new_blocks;
+      optimize_peak(search, depth + 1, new_bound);
+      search->code_used[code] = FALSE;
     }
-  }  
+    else
+      search->num_bound_prune++;
+
+    search->code_vector[s] = UNDEFINE;
+
+    // nothing left at this node can beat the best
+    if(is_pruned(search, bound))
+      return;
+  }
 }
 
-int get_peak_switch(int *code_list)
+/**************************************************
+set up the search state of a worker for a task
+***************************************************/
+void load_task(bf_search_t *search, bf_task_t *task)
 {
-  fsm_t *fsm = get_fsm();
+  bf_shared_t *shared = search->shared;
   int i;
-  int cs_id, ns_id;
-  int cs_code_value, ns_code_value;
-  int peak_switch;
 
-  peak_switch = 0;
+  for(i = 0; i < shared->fsm->num_state; i++)
+    search->code_vector[i] = UNDEFINE;
+  memset(search->code_used, 0, shared->num_code * sizeof(char));
 
-  for(i = 0; i < fsm->num_transition; i++) {
-    cs_id = (fsm->transition[i].current_state)->index;
-    ns_id = (fsm->transition[i].next_state)->index;
-    cs_code_value = code_list[cs_id];
-    ns_code_value = code_list[ns_id];
-    if(l2h_switch_tbl[cs_code_value][ns_code_value] > peak_switch)
-      peak_switch = l2h_switch_tbl[cs_code_value][ns_code_value];
-    if(h2l_switch_tbl[cs_code_value][ns_code_value] > peak_switch)
-      peak_switch = h2l_switch_tbl[cs_code_value][ns_code_value];
+  for(i = 0; i < task->depth; i++) {
+    search->code_vector[shared->state_order[i]] = task->prefix[i];
+    search->code_used[task->prefix[i]] = TRUE;
   }
+  search->block_start[task->depth] = task->block_start;
 }
 
 /**************************************************
-recursively apply all possible encoding to FSM
-and get the best encoding
+cut the top of the search tree into tasks, level
+by level, until there are enough tasks for the
+workers. the tasks stay in depth first order. the
+nodes split and the branches pruned here count in
+the statistics of search
 ***************************************************/
-void optimize_peak(int k, int n, int *output_vector, int *value_vector) 
-{
-  fsm_t *fsm = get_fsm();
-  int i = 0, j = 0;
-  int *new_value_vec = NULL;
-  int peak_switch = 0;
-
-  for(i = n-1; i >= 0; i--) {
-    // select a value from the value vector
-    output_vector[k] = value_vector[i];
-    if(k == 0) {
-      // if it's the last value, print out the permutation
-      peak_switch = get_peak_switch(output_vector);
-      if(peak_switch < globalPeakSwitch) {
-	globalPeakSwitch = peak_switch;
-	for(j = 0; j < fsm->num_state; j++)
-	  globalOptVector[j] = output_vector[j];
+void build_tasks(bf_shared_t *shared, bf_search_t *search, int lower_bound)
+{
+  fsm_t *fsm = shared->fsm;
+  int i, t, code;
+  int s, new_bound, new_blocks;
+  int num_next;
+  bf_task_t *next = NULL;
+  bf_task_t *task = NULL;
+
+  shared->num_task = 1;
+  shared->task = (bf_task_t *)calloc(1, sizeof(bf_task_t));
+  shared->task[0].depth = 0;
+  shared->task[0].bound = lower_bound;
+  shared->task[0].block_start = 1;
+  shared->task[0].prefix = NULL;
+  search->task_id = 0;
+
+  while(shared->num_task > 0 && shared->num_task < BF_TASK_PER_THREAD * shared->num_thread && shared->task[0].depth < fsm->num_state) {
+    num_next = 0;
+    next = NULL;
+    for(t = 0; t < shared->num_task; t++) {
+      task = &shared->task[t];
+      load_task(search, task);
+      s = shared->state_order[task->depth];
+      search->num_node++;
+
+      for(code = 0; code < shared->num_code; code++) {
+	if(search->code_used[code])
+	  continue;
+	if((new_blocks = canonical_blocks(search, task->depth, code)) == UNDEFINE) {
+	  search->num_sym_prune++;
+	  continue;
+	}
+
+	search->code_vector[s] = code;
+	new_bound = get_partial_peak_switch(search, s);
+	search->code_vector[s] = UNDEFINE;
+	if(new_bound < task->bound)
+	  new_bound = task->bound;
+	if(is_pruned(search, new_bound)) {
+	  search->num_bound_prune++;
+	  continue;
+	}
+
+	next = (bf_task_t *)realloc(next, (num_next + 1) * sizeof(bf_task_t));
+	next[num_next].depth = task->depth + 1;
+	next[num_next].bound = new_bound;
+	next[num_next].block_start = new_blocks;
+	next[num_next].prefix = (int *)malloc((task->depth + 1) * sizeof(int));
+	for(i = 0; i < task->depth; i++)
+	  next[num_next].prefix[i] = task->prefix[i];
+	next[num_next].prefix[task->depth] = code;
+	num_next++;
       }
+      free(task->prefix);
     }
-    else {
-      // exlude the selected value from value vector
-      new_value_vec = (int *)calloc(n - 1, sizeof(int));
-      for(j = 0; j < i; j++)
-	new_value_vec[j] = value_vector[j];
-      for(j = i; j < n-1; j++)
-	new_value_vec[j] = value_vector[j+1];
-
-      optimize_peak(k-1, n-1, output_vector, new_value_vec);
-      free(new_value_vec);
+
+    free(shared->task);
+    shared->task = next;
+    shared->num_task = num_next;
+  }
+}
+
+/**************************************************
+next task for a worker: the head of its own queue,
+else the tail of another worker's queue
+***************************************************/
+int next_task(bf_search_t *search)
+{
+  bf_shared_t *shared = search->shared;
+  bf_deque_t *deque = NULL;
+  int v;
+  int task_id = UNDEFINE;
+
+  for(v = 0; v < shared->num_thread && task_id == UNDEFINE; v++) {
+    deque = &shared->deque[(search->id + v) % shared->num_thread];
+    pthread_mutex_lock(&deque->lock);
+    if(deque->head < deque->tail) {
+      if(v == 0)
+	task_id = deque->task_list[deque->head++];
+      else
+	task_id = deque->task_list[--deque->tail];
     }
+    pthread_mutex_unlock(&deque->lock);
+  }
+
+  return task_id;
+}
+
+void *bf_worker(void *arg)
+{
+  bf_search_t *search = (bf_search_t *)arg;
+  bf_task_t *task = NULL;
+  int task_id;
+
+  while((task_id = next_task(search)) != UNDEFINE) {
+    task = &search->shared->task[task_id];
+    search->task_id = task_id;
+    load_task(search, task);
+    if(!is_pruned(search, task->bound))
+      optimize_peak(search, task->depth, task->bound);
+    else
+      search->num_bound_prune++;
   }
+
+  return NULL;
+}
+
+void init_search(bf_search_t *search, bf_shared_t *shared, int id)
+{
+  search->id = id;
+  search->task_id = 0;
+  search->shared = shared;
+  search->code_vector = (int *)calloc(shared->fsm->num_state, sizeof(int));
+  search->code_used = (char *)calloc(shared->num_code, sizeof(char));
+  search->block_start = (int *)calloc(shared->fsm->num_state + 1, sizeof(int));
+  search->num_node = 0;
+  search->num_leaf = 0;
+  search->num_bound_prune = 0;
+  search->num_sym_prune = 0;
+  search->num_improve = 0;
+}
+
+void free_search(bf_search_t *search)
+{
+  free(search->code_vector);
+  free(search->code_used);
+  free(search->block_start);
+}
+
+/**************************************************
+set the number of workers of the brute force
+search, 0 for one per processor
+***************************************************/
+void set_brute_force_threads(int num_thread)
+{
+  _bf_num_thread = num_thread;
 }
 
 /***********************************************
@@ -171,26 +442,117 @@ main engine for brute force encoding
 ***********************************************/
 boolean encode_brute_force(fsm_t *fsm)
 {
-  int i;
-  int max_num_code = pow(2, fsm->code_length);
-  int *code_vector = (int *)calloc(fsm->num_state, sizeof(int));
-  int *value_vector = (int *)calloc(max_num_code, sizeof(int));
+  int i, t;
+  int lower_bound = 0;
+  int seed_peak, best_peak, best_task;
+  int *opt_vector = NULL;
+  struct timespec start_time, end_time;
+  bf_shared_t shared;
+  bf_search_t *search = NULL;
+  pthread_t *thread = NULL;
+  long num_node = 0, num_leaf = 0, num_bound_prune = 0, num_sym_prune = 0, num_improve = 0;
+  boolean ret_flag;
 
-  globalPeakSwitch = 0;
-  globalOptVector = (int *)calloc(fsm->num_state, sizeof(int));
-  for(i = 0; i < fsm->num_state; i++)
-    globalOptVector[i] = 0;
+  if(fsm->code_length > 16) {
+    printf("ERROR: code length %d is too long for brute force encoding.\n", fsm->code_length);
+    return FALSE;
+  }
+
+  shared.fsm = fsm;
+  shared.num_code = 1 << fsm->code_length;
+  shared.num_thread = _bf_num_thread > 0 ? _bf_num_thread : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if(shared.num_thread < 1)
+    shared.num_thread = 1;
+  // the peak switching of a transition is the same in both
+  // directions, the neighbors are all the search needs
+  if(get_state_adjacency(fsm, &shared.adj_ptr, &shared.adj_state, NULL) == FALSE)
+    return FALSE;
+  shared.state_order = (int *)calloc(fsm->num_state, sizeof(int));
+  order_states(&shared);
 
-  for(i = 0; i < max_num_code; i++)
-    value_vector[i] = i;
-  
-  // return the code to FSM
-  optimize_peak(fsm->num_state, max_num_code, code_vector, value_vector); 
+  // two different states always switch at least one bit
+  if(shared.adj_ptr[fsm->num_state] > 0)
+    lower_bound = 1;
+
+  // the POW3 encoding is the first incumbent, else the state indices
+  opt_vector = (int *)calloc(fsm->num_state, sizeof(int));
+  if(encode_pow3(fsm) == FALSE || get_fsm_code_vector(fsm, opt_vector) == FALSE) {
+    for(i = 0; i < fsm->num_state; i++)
+      opt_vector[i] = i;
+  }
+  seed_peak = get_peak_switch(fsm, opt_vector);
+  shared.best_key = (uint64_t)seed_peak << 32;
 
-  printf("The peak switch is %d\n", globalPeakSwitch);
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+  search = (bf_search_t *)calloc(shared.num_thread, sizeof(bf_search_t));
+  for(t = 0; t < shared.num_thread; t++)
+    init_search(&search[t], &shared, t);
+
+  shared.num_task = 0;
+  shared.task = NULL;
+  if(seed_peak > lower_bound)
+    build_tasks(&shared, &search[0], lower_bound);
+
+  // deal the tasks out round robin, each queue in task order
+  shared.task_best = (int *)calloc((size_t)(shared.num_task + 1) * fsm->num_state, sizeof(int));
+  shared.deque = (bf_deque_t *)calloc(shared.num_thread, sizeof(bf_deque_t));
+  for(t = 0; t < shared.num_thread; t++) {
+    shared.deque[t].task_list = (int *)calloc(shared.num_task / shared.num_thread + 1, sizeof(int));
+    pthread_mutex_init(&shared.deque[t].lock, NULL);
+  }
+  for(i = 0; i < shared.num_task; i++) {
+    t = i % shared.num_thread;
+    shared.deque[t].task_list[shared.deque[t].tail++] = i;
+  }
+
+  thread = (pthread_t *)calloc(shared.num_thread, sizeof(pthread_t));
+  for(t = 0; t < shared.num_thread; t++)
+    pthread_create(&thread[t], NULL, bf_worker, &search[t]);
+  for(t = 0; t < shared.num_thread; t++)
+    pthread_join(thread[t], NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &end_time);
+
+  best_peak = (int)(shared.best_key >> 32);
+  best_task = (int)(shared.best_key & 0xffffffff) - 1;
+  if(best_task >= 0)
+    memcpy(opt_vector, shared.task_best + (size_t)best_task * fsm->num_state, fsm->num_state * sizeof(int));
+
+  for(t = 0; t < shared.num_thread; t++) {
+    num_node += search[t].num_node;
+    num_leaf += search[t].num_leaf;
+    num_bound_prune += search[t].num_bound_prune;
+    num_sym_prune += search[t].num_sym_prune;
+    num_improve += search[t].num_improve;
+  }
+
+  printf("The initial peak switch is %d\n", seed_peak);
+  printf("The peak switch is %d\n", best_peak);
   printf("The optimal state code vector is:");
-  for(i = 0; fsm->num_state; i++)
-    printf(" %d", globalOptVector[i]);
+  for(i = 0; i < fsm->num_state; i++)
+    printf(" %d", opt_vector[i]);
   printf("\n");
-  return TRUE;
+  printf("Optimality proved: %d threads, %d tasks, %ld nodes, %ld leaves, %ld bound prunes, %ld symmetry prunes, %ld improvements, %.2f seconds\n", shared.num_thread, shared.num_task, num_node, num_leaf, num_bound_prune, num_sym_prune, num_improve, (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9);
+
+  ret_flag = set_fsm_code_vector(fsm, opt_vector);
+
+  for(i = 0; i < shared.num_task; i++)
+    free(shared.task[i].prefix);
+  free(shared.task);
+  for(t = 0; t < shared.num_thread; t++) {
+    free(shared.deque[t].task_list);
+    pthread_mutex_destroy(&shared.deque[t].lock);
+    free_search(&search[t]);
+  }
+  free(shared.deque);
+  free(shared.task_best);
+  free(shared.state_order);
+  pow3_free(shared.adj_ptr);
+  pow3_free(shared.adj_state);
+  free(search);
+  free(thread);
+  free(opt_vector);
+
+  return ret_flag;
 }
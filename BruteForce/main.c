@@ -8,6 +8,7 @@
 
 extern boolean write_fsm_to_blif_by_index(char *file_name, fsm_t *fsm);
 extern boolean encode_brute_force(fsm_t *fsm);
+extern void set_brute_force_threads(int num_thread);
 
 int main(int argc, char **argv)
 {
@@ -17,15 +18,19 @@ int main(int argc, char **argv)
   char *temp_name;
   double switching = 0;
   
-  infile_name = argv[1];
-
+  // -t n searches with n workers, one per processor by default
+  if(argc > 3 && !strcmp(argv[1], "-t")) {
+    set_brute_force_threads(atoi(argv[2]));
+    infile_name = argv[3];
+  }
+  else
+    infile_name = argv[1];
 
-  init_fsm();  
-  fsm = get_fsm();
+  fsm = init_fsm();
 
-  if(read_fsm_from_blif(infile_name, fsm) == FALSE) {
+  if(read_fsm_from_blif_mmap(infile_name, fsm) == FALSE) {
     printf("ERROR: Unable to build FSM for %s.\n", fsm->name);
-    free_fsm();
+    free_fsm(fsm);
     exit(1);
   }
 
@@ -43,7 +48,7 @@ int main(int argc, char **argv)
 
   free(temp_name);
   free(outfile_name);
-  free(fsm);
+  free_fsm(fsm);
 
   return 0;
 }
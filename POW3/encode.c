@@ -28,241 +28,418 @@
 #include <string.h>
 #include "struct.h"
 #include "global.h"
+#include "context.h"
+#include "matrix_util.h"
 #include "pow3_struct.h"
 
-extern int hamming_distance(char *s1, char *s2, int n);
-extern double **get_trans_prob(fsm_t *fsm);
-
-// global variable
-pow3_stg_t *_pow3_stg;
+extern int hamming_distance_bits(uint64_t *a, uint64_t *b, int num_words);
+extern boolean pack_fsm_codes(fsm_t *fsm);
+extern csr_matrix_t *get_trans_prob_csr(fsm_t *fsm);
+extern boolean set_state_code(fsm_t *fsm, state_t *state, char *code);
+void free_stg(pow3_stg_t *stg);
+void sort_edge(pow3_edge_t *edge_list, int num_edge);
+int select_bit(pow3_stg_t *stg, pow3_node_t *n1, pow3_node_t *n2, int k);
+int class_violation(pow3_stg_t *stg, pow3_node_t *n1, pow3_node_t *n2, int k);
 
 /******************************** 
-initialize the matrix for pow3 
+build the STG for pow3. the weight
+of the undirected edge i-j is the
+total transition probability i->j
+plus j->i, stored as a sparse
+adjacency of each node. the STG
+and its arrays are taken from one
+arena sized for them
 **********************************/
-boolean initialize_stg(fsm_t *fsm)
+pow3_stg_t *initialize_stg(fsm_t *fsm, csr_matrix_t *trans_prob)
 {
-  int i, j;
-  int num_edge;
-  double **trans_prob = NULL;
-  double **weight_matrix = NULL;
+  int i, j, k, n;
+  int num_adj, num_edge, num_touched;
+  int code_words;
+  size_t size;
+  int *touched = NULL;
+  double *row_weight = NULL;
+  csr_matrix_t *trans_prob_t = NULL;
+  pow3_stg_t *stg = NULL;
+  pow3_arena_t arena;
+
+  if(fsm == NULL || trans_prob == NULL)
+    return NULL;
+
+  n = fsm->num_state;
+  code_words = NUM_WORDS(fsm->code_length) > 0 ? NUM_WORDS(fsm->code_length) : 1;
+
+  // every array below, with room for the alignment of each
+  size = sizeof(pow3_stg_t) + (size_t)n * (sizeof(pow3_node_t) + sizeof(pow3_set_t) + sizeof(pow3_node_t *));
+  size += (size_t)n * (code_words * sizeof(uint64_t) + fsm->code_length + 1 + sizeof(int));
+  size += (size_t)(2 * trans_prob->num_nz + 1) * (sizeof(int) + sizeof(double));
+  size += (size_t)(trans_prob->num_nz + 1) * 2 * sizeof(pow3_edge_t);
+  size += 16 * ARENA_ALIGN;
+
+  init_arena(&arena, size);
+  if((stg = (pow3_stg_t *)arena_alloc(&arena, sizeof(pow3_stg_t))) == NULL)
+    return NULL;
+  stg->arena = arena;
+
+  stg->num_node = n; 
+  stg->code_length = fsm->code_length;
+  stg->code_words = code_words;
+  stg->node = (pow3_node_t *)arena_alloc(&stg->arena, n * sizeof(pow3_node_t));
+  stg->set = (pow3_set_t *)arena_alloc(&stg->arena, n * sizeof(pow3_set_t));
+  stg->set_nodes = (pow3_node_t **)arena_alloc(&stg->arena, (n + 1) * sizeof(pow3_node_t *));
+  stg->code_block = (uint64_t *)arena_alloc(&stg->arena, (size_t)n * stg->code_words * sizeof(uint64_t));
+  stg->code_chars = (char *)arena_alloc(&stg->arena, (size_t)n * (stg->code_length + 1));
+  if(stg->node == NULL || stg->set == NULL || stg->set_nodes == NULL || stg->code_block == NULL || stg->code_chars == NULL)
+    goto failure;
 
-  if(fsm == NULL)
-    return FALSE;
+  stg->num_set = 0;
+  for(i = 0; i < stg->num_node; i++) {
+    stg->set[i].set_size = 0;
+    stg->set[i].node_list = NULL;
+  }
+  
 
-  trans_prob = get_trans_prob(fsm);  
-  if(trans_prob == NULL)
-    return FALSE;
+  for(i = 0; i < stg->num_node; i++) {
+    stg->node[i].index = i;
+    stg->node[i].state = &fsm->state[i];
+    stg->node[i].set_id = UNDEFINE;
+    stg->node[i].class_key = 0;
+    stg->node[i].code = stg->code_chars + (size_t)i * (stg->code_length + 1);
+    for(j = 0; j < stg->code_length; j++)
+      stg->node[i].code[j] = 'x';
+    stg->node[i].code_bits = stg->code_block + (size_t)i * stg->code_words;
+  }
 
-  weight_matrix = (double **)calloc(fsm->num_state, sizeof(double *));
-  for(i = 0; i < fsm->num_state; i++) {
-    weight_matrix[i] = (double *)calloc(fsm->num_state, sizeof(double));
-    for(j = 0; j < fsm->num_state; j++) {
-      if(trans_prob[i][j] > 0 || trans_prob[j][i] > 0)
-	weight_matrix[i][j] = trans_prob[i][j] + trans_prob[j][i];
-      else
-	weight_matrix[i][j] = 0;
+  // merge the outgoing and incoming transitions of every node,
+  // don't consider self loop as an edge
+  stg->adj_ptr = (int *)arena_alloc(&stg->arena, (n + 1) * sizeof(int));
+  stg->adj_node = (int *)arena_alloc(&stg->arena, (2 * trans_prob->num_nz + 1) * sizeof(int));
+  stg->adj_weight = (double *)arena_alloc(&stg->arena, (2 * trans_prob->num_nz + 1) * sizeof(double));
+  if(stg->adj_ptr == NULL || stg->adj_node == NULL || stg->adj_weight == NULL)
+    goto failure;
+  trans_prob_t = csr_transpose(trans_prob);
+  row_weight = (double *)pow3_calloc(n, sizeof(double));
+  touched = (int *)pow3_malloc((n + 1) * sizeof(int));
+  if(trans_prob_t == NULL || row_weight == NULL || touched == NULL)
+    goto failure;
+
+  num_adj = 0;
+  num_edge = 0;
+  for(i = 0; i < n; i++) {
+    num_touched = 0;
+    for(k = trans_prob->row_ptr[i]; k < trans_prob->row_ptr[i + 1]; k++) {
+      j = trans_prob->col_idx[k];
+      if(j == i)
+	continue;
+      if(row_weight[j] == 0)
+	touched[num_touched++] = j;
+      row_weight[j] += trans_prob->val[k];
+    }
+    for(k = trans_prob_t->row_ptr[i]; k < trans_prob_t->row_ptr[i + 1]; k++) {
+      j = trans_prob_t->col_idx[k];
+      if(j == i)
+	continue;
+      if(row_weight[j] == 0)
+	touched[num_touched++] = j;
+      row_weight[j] += trans_prob_t->val[k];
     }
-  }
 
-  _pow3_stg = (pow3_stg_t *)malloc(sizeof(pow3_stg_t));
-  _pow3_stg->num_node = fsm->num_state; 
-  _pow3_stg->code_length = fsm->code_length;
-  _pow3_stg->weight_matrix = weight_matrix;
-  _pow3_stg->node = (pow3_node_t *)calloc(_pow3_stg->num_node, sizeof(pow3_node_t));
-  _pow3_stg->set = (pow3_set_t *)calloc(_pow3_stg->num_node, sizeof(pow3_set_t));
-
-  _pow3_stg->num_set = 0;
-  for(i = 0; i < _pow3_stg->num_node; i++) {
-    _pow3_stg->set[i].set_size = 0;
-    _pow3_stg->set[i].node_list = NULL;
+    stg->adj_ptr[i] = num_adj;
+    for(k = 0; k < num_touched; k++) {
+      j = touched[k];
+      if(row_weight[j] > 0) {
+	stg->adj_node[num_adj] = j;
+	stg->adj_weight[num_adj] = row_weight[j];
+	num_adj++;
+	if(j > i)
+	  num_edge++;
+      }
+      row_weight[j] = 0;
+    }
   }
-  
+  stg->adj_ptr[n] = num_adj;
 
-  for(i = 0; i < _pow3_stg->num_node; i++) {
-    _pow3_stg->node[i].index = i;
-    _pow3_stg->node[i].state = &fsm->state[i];
-    _pow3_stg->node[i].set_id = UNDEFINE;
-    _pow3_stg->node[i].code = (char *)calloc(_pow3_stg->code_length + 1, sizeof(char));
-    for(j = 0; j < _pow3_stg->code_length; j++)
-      _pow3_stg->node[i].code[j] = 'x';
-  }
+  stg->num_edge = num_edge;
+  stg->edge_list = (pow3_edge_t *)arena_alloc(&stg->arena, (num_edge + 1) * sizeof(pow3_edge_t));
+  stg->edge_buffer = (pow3_edge_t *)arena_alloc(&stg->arena, (num_edge + 1) * sizeof(pow3_edge_t));
+  if(stg->edge_list == NULL || stg->edge_buffer == NULL)
+    goto failure;
 
   num_edge = 0;
-  // don't consider self loop as an edge
-  for(i = 0; i < fsm->num_state; i++) {
-    for(j = i + 1; j < fsm->num_state; j++) {
-      if(weight_matrix[i][j] > 0) {
+  for(i = 0; i < n; i++) {
+    for(k = stg->adj_ptr[i]; k < stg->adj_ptr[i + 1]; k++) {
+      j = stg->adj_node[k];
+      if(j > i) {
+	stg->edge_list[num_edge].n1 = &stg->node[i];
+	stg->edge_list[num_edge].n2 = &stg->node[j];
+	stg->edge_list[num_edge].weight = stg->adj_weight[k];
 	num_edge++;
-	if(num_edge == 1)
-	  _pow3_stg->edge_list = (pow3_edge_t **)calloc(1, sizeof(pow3_edge_t *));
-	else
-	  _pow3_stg->edge_list = (pow3_edge_t **)realloc(_pow3_stg->edge_list, num_edge*sizeof(pow3_edge_t *));
-	_pow3_stg->edge_list[num_edge-1] = (pow3_edge_t *)malloc(sizeof(pow3_edge_t));
-	_pow3_stg->edge_list[num_edge-1]->n1 = &_pow3_stg->node[i];
-	_pow3_stg->edge_list[num_edge-1]->n2 = &_pow3_stg->node[j];
-	_pow3_stg->edge_list[num_edge-1]->weight = weight_matrix[i][j];
       }
     }  
   }
   
-  _pow3_stg->num_edge = num_edge;
-  free(trans_prob);
+  sort_edge(stg->edge_list, num_edge);
+
+  pow3_free(row_weight);
+  pow3_free(touched);
+  free_csr_matrix(trans_prob_t);
+
+  return stg;
+
+ failure:
+  pow3_free(row_weight);
+  pow3_free(touched);
+  if(trans_prob_t)
+    free_csr_matrix(trans_prob_t);
+  free_stg(stg);
+
+  return NULL;
+}
+
+/*****************************************
+ order of edges: decreasing weights, ties
+ broken by the node indices so that the
+ order does not depend on the sort method
+******************************************/
+int compare_edge(const void *a, const void *b)
+{
+  const pow3_edge_t *e1 = (const pow3_edge_t *)a;
+  const pow3_edge_t *e2 = (const pow3_edge_t *)b;
+
+  if(e1->weight != e2->weight)
+    return e1->weight < e2->weight ? 1 : -1;
+  if(e1->n1->index != e2->n1->index)
+    return e1->n1->index - e2->n1->index;
+  return e1->n2->index - e2->n2->index;
 }
 
 /*****************************************
  sort array of edges by weights 
  in decreasing order
 ******************************************/
-void sort_edge(pow3_edge_t **edge_list, int num_edge)
+void sort_edge(pow3_edge_t *edge_list, int num_edge)
 {
-  int i, j;
-  pow3_edge_t *temp_edge;
-
-  for(i = 0; i < num_edge; i++) {
-    for(j = i + 1; j < num_edge; j++) {
-      if(edge_list[i]->weight < edge_list[j]->weight) {
-	temp_edge = edge_list[i];
-	edge_list[i] = edge_list[j];
-	edge_list[j] = temp_edge;
-      }
+  qsort(edge_list, num_edge, sizeof(pow3_edge_t), compare_edge);
+}
+
+/*****************************************
+ restore the order of the edge list after
+ the weights were scaled. scale[i] is the 
+ factor applied to the i-th edge, ranging
+ over 1..num_class. the edges of one scale
+ class are still sorted, so the list is 
+ split by class and the classes are merged.
+ FALSE if out of memory
+******************************************/
+boolean merge_edge(pow3_stg_t *stg, int *scale, int num_class)
+{
+  int i, c, best;
+  int *head = (int *)pow3_calloc(num_class + 2, sizeof(int));
+  int *tail = (int *)pow3_calloc(num_class + 2, sizeof(int));
+  pow3_edge_t *buffer = stg->edge_buffer;
+
+  if(head == NULL || tail == NULL) {
+    pow3_free(head);
+    pow3_free(tail);
+    return FALSE;
+  }
+
+  // stable partition of the edges by scale class
+  for(i = 0; i < stg->num_edge; i++)
+    head[scale[i] + 1]++;
+  for(c = 1; c <= num_class; c++)
+    head[c + 1] += head[c];
+  for(c = 1; c <= num_class + 1; c++)
+    tail[c] = head[c];
+  for(i = 0; i < stg->num_edge; i++)
+    buffer[tail[scale[i]]++] = stg->edge_list[i];
+
+  // merge the sorted classes back into the edge list
+  for(i = 0; i < stg->num_edge; i++) {
+    best = UNDEFINE;
+    for(c = 1; c <= num_class; c++) {
+      if(head[c] == tail[c])
+	continue;
+      if(best == UNDEFINE || compare_edge(&buffer[head[c]], &buffer[head[best]]) < 0)
+	best = c;
     }
+    stg->edge_list[i] = buffer[head[best]++];
   }
+
+  pow3_free(head);
+  pow3_free(tail);
+  return TRUE;
 }
   
+/***************************************
+ set the l-th bit of a node and keep the
+ counters of its set up to date
+****************************************/
+void set_code_bit(pow3_stg_t *stg, pow3_node_t *node, int l, char bit)
+{
+  pow3_set_t *node_set = &stg->set[node->set_id];
+
+  if(node->code[l] == 'x')
+    node_set->num_unassigned--;
+  else if(node->code[l] == '0')
+    node_set->num_zero--;
+  else if(node->code[l] == '1')
+    node_set->num_one--;
+
+  node->code[l] = bit;
+  if(bit == '1')
+    node->code_bits[l / WORD_BITS] |= (uint64_t)1 << (l % WORD_BITS);
+  else
+    node->code_bits[l / WORD_BITS] &= ~((uint64_t)1 << (l % WORD_BITS));
+
+  if(bit == '0')
+    node_set->num_zero++;
+  else if(bit == '1')
+    node_set->num_one++;
+  else
+    node_set->num_unassigned++;
+}
+
+/***************************************
+ assign the unassigned nodes of a set 
+ once it has ENOUGH ones or zeros, since
+ they have only one code left that does
+ not violate the class constraint
+****************************************/
+void force_set(pow3_stg_t *stg, pow3_set_t *node_set, int l)
+{
+  int k;
+
+  if(node_set->set_size < node_set->capacity || node_set->num_unassigned == 0)
+    return;
+
+  if(node_set->num_one >= node_set->capacity)
+    for(k = 0; k < node_set->set_size; k++)
+      if(node_set->node_list[k]->code[l] == 'x')
+	set_code_bit(stg, node_set->node_list[k], l, '0');
+  if(node_set->num_zero >= node_set->capacity)
+    for(k = 0; k < node_set->set_size; k++)
+      if(node_set->node_list[k]->code[l] == 'x')
+	set_code_bit(stg, node_set->node_list[k], l, '1');
+}
+
 /***************************************
  assign the l-th bit to all states 
 ****************************************/  
 void assign(pow3_stg_t *stg, int l)
 {
-  int i,j,k;
+  int i;
   int x;
-  int num_zeros = 0;
-  int num_ones = 0;
   pow3_node_t *node1 = NULL;
   pow3_node_t *node2 = NULL;
 
-  sort_edge(stg->edge_list, stg->num_edge);
-  
   // assign codes to two states in decreasing order of the weights on edges
   for(i = 0; i < stg->num_edge; i++) {
-    node1 = stg->edge_list[i]->n1;
-    node2 = stg->edge_list[i]->n2;
+    node1 = stg->edge_list[i].n1;
+    node2 = stg->edge_list[i].n2;
 
     if(node1->code[l] == 'x' && node2->code[l] == 'x') {
       // if both states have not been assigned at bit l
       x = select_bit(stg, node1, node2, l);
-      if(class_violation(node1, node2, l) == 0) { // no class violation
-	node1->code[l] = '0' + x;
-	node2->code[l] = '0' + x;
+      if(class_violation(stg, node1, node2, l) == 0) { // no class violation
+	set_code_bit(stg, node1, l, '0' + x);
+	set_code_bit(stg, node2, l, '0' + x);
       }
-      else if(class_violation(node1, node2, l) == 2 && x != 0) { // If assign bit 1, no class violation
-	node1->code[l] = '0' + x;
-	node2->code[l] = '0' + x;
+      else if(class_violation(stg, node1, node2, l) == 2 && x != 0) { // If assign bit 1, no class violation
+	set_code_bit(stg, node1, l, '0' + x);
+	set_code_bit(stg, node2, l, '0' + x);
       }
-      else if(class_violation(node1, node2, l) == 3 && x != 1) { // If assign bit 0, no class violation
-	node1->code[l] = '0' + x;
-	node2->code[l] = '0' + x;
+      else if(class_violation(stg, node1, node2, l) == 3 && x != 1) { // If assign bit 0, no class violation
+	set_code_bit(stg, node1, l, '0' + x);
+	set_code_bit(stg, node2, l, '0' + x);
       }
       else { // class violation
-	node1->code[l] = '0' + x;
-	node2->code[l] = '0' + 1 - x;
+	set_code_bit(stg, node1, l, '0' + x);
+	set_code_bit(stg, node2, l, '0' + 1 - x);
       }
     }
     else {
       if(node1->code[l] == 'x') { // if fisrt state has NOT been assigned
-	if(!class_violation(node1, node2, l)) {
+	if(!class_violation(stg, node1, node2, l)) {
 	  x = select_bit(stg, node1, node2, l);
-	  node1->code[l] = '0' + x;
+	  set_code_bit(stg, node1, l, '0' + x);
 	}
 	else {
 	  if(node2->code[l] == '0')
-	    node1->code[l] = '1';
+	    set_code_bit(stg, node1, l, '1');
 	  else
-	    node1->code[l] = '0';
+	    set_code_bit(stg, node1, l, '0');
 	}
       }
       if(node2->code[l] == 'x')  { // if second state has NOT been assigned
-	if(!class_violation(node1, node2, l)) {
+	if(!class_violation(stg, node1, node2, l)) {
 	  x = select_bit(stg, node1, node2, l);
-	  node2->code[l] = '0' + x;
+	  set_code_bit(stg, node2, l, '0' + x);
 	}
 	else {
-	  if(node1->code[l] = '0')
-	    node2->code[l] = '1';
+	  if(node1->code[l] == '0')
+	    set_code_bit(stg, node2, l, '1');
 	  else
-	    node2->code[l] = '0';
+	    set_code_bit(stg, node2, l, '0');
 	}
       }
     }
     
-    pow3_set_t *node_set;
-    // assign code to the rest states that have only one code to not violate class constraints
-    for(j = 0; j < stg->num_node; j++) {
-      node_set = &(stg->set[stg->node[j].set_id]);
-      if(node_set->set_size >= pow(2, stg->code_length -l -1)) {
-	num_ones = 0;
-	num_zeros = 0;
-	// check how many ones or zeros for each class
-	for(k = 0; k < stg->num_node; k++) {
-	  if(stg->node[k].set_id == stg->node[j].set_id) {
-	    if(stg->node[k].code[l] == '1')
-	      num_ones++;
-	    if(stg->node[k].code[l] == '0')
-	      num_zeros++;
-	  }
-	}
-	// assign the unassigned states in the class where there are ENOUGH ones or zeros
-	if(num_ones >= pow(2, stg->code_length-l-1))
-	  for(k = 0; k < stg->num_node; k++)
-	    if(stg->node[k].set_id == stg->node[j].set_id && stg->node[k].code[l] == 'x')
-	      stg->node[k].code[l] = '0';
-	if(num_zeros >= pow(2, stg->code_length-l-1))
-	  for(k = 0; k < stg->num_node; k++)
-	    if(stg->node[k].set_id == stg->node[j].set_id && stg->node[k].code[l] == 'x')
-	      stg->node[k].code[l] = '1';
-      }
-    }
+    // only the sets of the two nodes can have changed
+    force_set(stg, &stg->set[node1->set_id], l);
+    if(node2->set_id != node1->set_id)
+      force_set(stg, &stg->set[node2->set_id], l);
   }
 }
 
-/*************************
-get the current STG
-**************************/
-pow3_stg_t *get_stg(void)
+/***************************************
+ states on no weighted edge, like those of
+ zero steady state probability, are left
+ unassigned by assign(). they take the
+ half of their set that still has room
+****************************************/
+void assign_rest(pow3_stg_t *stg, int l)
 {
-  return _pow3_stg;
+  int i;
+  pow3_set_t *node_set;
+
+  for(i = 0; i < stg->num_node; i++) {
+    if(stg->node[i].code[l] != 'x')
+      continue;
+    node_set = &stg->set[stg->node[i].set_id];
+    if(node_set->num_zero < node_set->capacity)
+      set_code_bit(stg, &stg->node[i], l, '0');
+    else
+      set_code_bit(stg, &stg->node[i], l, '1');
+  }
 }
 
 /**************************************************** 
 decide whether there will be class violation if two 
 states are assigned the same code at the k-th bit 
 *****************************************************/
-int class_violation(pow3_node_t *n1, pow3_node_t *n2, int k)
+int class_violation(pow3_stg_t *stg, pow3_node_t *n1, pow3_node_t *n2, int k)
 {
-  int i;
-  pow3_stg_t *stg = get_stg();
+  pow3_set_t *node_set = NULL;
   int undistinct_zero = 0;
   int undistinct_one = 0;
+  int capacity = 0;
  
   if(n1->set_id != n2->set_id)
     return 0;                                       //No class violation
 
-  for(i = 0; i < stg->num_node; i++) {
-    if(&stg->node[i] != n1 && &stg->node[i] != n2 && stg->node[i].set_id == n1->set_id) {
-      if(stg->node[i].code[k] == '0')
-	undistinct_zero++;
-      if(stg->node[i].code[k] == '1')
-	undistinct_one++;
-    }
-  }
+  // nodes of the set other than n1 and n2 assigned 0 or 1
+  node_set = &stg->set[n1->set_id];
+  capacity = node_set->capacity;
+  undistinct_zero = node_set->num_zero - (n1->code[k] == '0') - (n2->code[k] == '0');
+  undistinct_one = node_set->num_one - (n1->code[k] == '1') - (n2->code[k] == '1');
 
   if(n1->code[k] == 'x') {
     /* if both state m and n have not been assigned */
-    if((undistinct_zero + 2) > pow(2, stg->code_length-k-1) && (undistinct_one + 2) > pow(2, stg->code_length-k-1))
+    if((undistinct_zero + 2) > capacity && (undistinct_one + 2) > capacity)
       return 1;                                            /* class violated */
-    else if(undistinct_zero + 2 > pow(2, stg->code_length-k-1))
+    else if(undistinct_zero + 2 > capacity)
       return 2;                                            /* no violation if assgin bit 1 */
-    else if(undistinct_one + 2 > pow(2, stg->code_length-k-1))
+    else if(undistinct_one + 2 > capacity)
       return 3;                                            /* no violation if assign bit 0 */
     else
       return 0;                                            /* no violation */
@@ -270,18 +447,20 @@ int class_violation(pow3_node_t *n1, pow3_node_t *n2, int k)
   else {
     /* if one state has been assigned */
     if(n1->code[k] == '1') {
-      if(undistinct_one + 1 > pow(2, stg->code_length-k-1))
+      if(undistinct_one + 1 > capacity)
 	return 1;                                        /* class violated */
       else
 	return 0;                                        /* no class violation */
     }
     if(n1->code[k] == '0') {
-      if(undistinct_zero+1>pow(2, stg->code_length-k-1))
+      if(undistinct_zero + 1 > capacity)
 	return 1;                                        /* class violated */
       else
 	return 0;                                        /* no class violation */
     }
   }
+
+  return 0;
 }
   
 /****************************************************
@@ -289,21 +468,28 @@ select the code for k-th bit of two states
 *****************************************************/
 int select_bit(pow3_stg_t *stg, pow3_node_t *n1, pow3_node_t *n2, int k)
 {
-  int i;
+  int i, j;
   double oneEdgeVio = 0;
   double zeroEdgeVio = 0;
   int assignBit = 0;
-  double **weight = stg->weight_matrix;
+  pow3_node_t *node = NULL;
+  pow3_node_t *ends[2];
 
   zeroEdgeVio = 0; // total edge violation if assign bit 0
   oneEdgeVio = 0;  // total edge violation if assign bit 1
 
-  for(i = 0; i < stg->num_node; i++) {
-    if(&stg->node[i] != n1 && &stg->node[i] != n2) {
-      if(stg->node[i].code[k] == '0')
-	oneEdgeVio = oneEdgeVio + weight[n1->index][i] + weight[n2->index][i];
-      if(stg->node[i].code[k] == '1')
-	zeroEdgeVio = zeroEdgeVio + weight[n1->index][i] + weight[n2->index][i];
+  // only the neighbors of the two nodes contribute
+  ends[0] = n1;
+  ends[1] = n2;
+  for(j = 0; j < 2; j++) {
+    for(i = stg->adj_ptr[ends[j]->index]; i < stg->adj_ptr[ends[j]->index + 1]; i++) {
+      node = &stg->node[stg->adj_node[i]];
+      if(node == n1 || node == n2)
+	continue;
+      if(node->code[k] == '0')
+	oneEdgeVio = oneEdgeVio + stg->adj_weight[i];
+      if(node->code[k] == '1')
+	zeroEdgeVio = zeroEdgeVio + stg->adj_weight[i];
     }
   }
 
@@ -316,177 +502,221 @@ int select_bit(pow3_stg_t *stg, pow3_node_t *n1, pow3_node_t *n2, int k)
 }
 
 /*********************************************
-add a node to the k-th set in STG
+extend the key of the partial code of a node
+by its l-th bit: two bits per assigned
+position, so a node left unassigned ('x') at
+some earlier bit is kept apart from the 0s
+and 1s
 *********************************************/
-void add_node_to_set(pow3_stg_t *stg, pow3_node_t *node, int k)
+void extend_class_key(pow3_node_t *node, int l)
 {
-  int num_element;
-  node->set_id = k;
-  stg->set[k].set_size++;
-  num_element = stg->set[k].set_size;
-  if(num_element == 1)
-    stg->set[k].node_list = (pow3_node_t **)calloc(num_element, sizeof(pow3_node_t *));
-  else
-    stg->set[k].node_list = (pow3_node_t **)realloc(stg->set[k].node_list, num_element * sizeof(pow3_node_t *));
-  
-  stg->set[k].node_list[num_element - 1] = node;
+  node->class_key <<= 2;
+  if(node->code[l] == '0')
+    node->class_key |= 1;
+  else if(node->code[l] == '1')
+    node->class_key |= 2;
 }
 
 /**************************************************
-  calculate the classes and the size of each class 
+  calculate the classes and the size of each class
+  before assigning the l-th bit. nodes with the
+  same partial code belong to the same set; sets
+  are numbered in order of their first node and
+  laid out contiguously in set_nodes. called for
+  l = 0, 1, ... in turn, as the keys are extended
+  by one bit each time. FALSE if out of memory
 **************************************************/
-void adjust_class_constr(pow3_stg_t *stg)
+boolean adjust_class_constr(pow3_stg_t *stg, int l)
 {
-  int i,j;
-  int set_id = 0;
-
-  for(i = 0; i < stg->num_node; i++) {
-    stg->node[i].set_id = UNDEFINE;
-  }
+  int i, k, slot;
+  int hash_size = 16;
+  int *hash_set = NULL;
+  int *next = NULL;
+  uint64_t *hash_key = NULL;
+  uint64_t key;
+  pow3_set_t *node_set = NULL;
 
   // reset all the sets in STG
   for(i = 0; i < stg->num_set; i++) {
     stg->set[i].set_size = 0;
-    free(stg->set[i].node_list);
+    stg->set[i].num_zero = 0;
+    stg->set[i].num_one = 0;
+    stg->set[i].num_unassigned = 0;
     stg->set[i].node_list = NULL;
   }
   stg->num_set = 0;
 
+  while(hash_size < 2 * stg->num_node)
+    hash_size <<= 1;
+  hash_set = (int *)pow3_malloc(hash_size * sizeof(int));
+  hash_key = (uint64_t *)pow3_malloc(hash_size * sizeof(uint64_t));
+  next = (int *)pow3_malloc((stg->num_node + 1) * sizeof(int));
+  if(hash_set == NULL || hash_key == NULL || next == NULL) {
+    pow3_free(hash_set);
+    pow3_free(hash_key);
+    pow3_free(next);
+    return FALSE;
+  }
+  for(i = 0; i < hash_size; i++)
+    hash_set[i] = UNDEFINE;
+
   for(i = 0; i < stg->num_node; i++) {
-    // if two nodes have same partial code, they belong to same set
-    for(j = 0; j < i; j++) {
-      if(stg->node[j].set_id != UNDEFINE && hamming_distance(stg->node[i].code, stg->node[j].code, stg->code_length) == 0) {
-	set_id = stg->node[j].set_id;
-	add_node_to_set(stg, &stg->node[i], set_id);
-	break;
-      }
-    }
-    // else add this node to a new set
-    if(stg->node[i].set_id == UNDEFINE) {
-      add_node_to_set(stg, &stg->node[i], stg->num_set);
-      stg->num_set++;
+    // the key before bit l is the one before bit l-1 and bit l-1
+    if(l == 0)
+      stg->node[i].class_key = 0;
+    else
+      extend_class_key(&stg->node[i], l - 1);
+    key = stg->node[i].class_key;
+    slot = (int)((key * 0x9E3779B97F4A7C15ULL) >> 40) & (hash_size - 1);
+    while(hash_set[slot] != UNDEFINE && hash_key[slot] != key)
+      slot = (slot + 1) & (hash_size - 1);
+
+    // a partial code not seen before starts a new set
+    if(hash_set[slot] == UNDEFINE) {
+      hash_set[slot] = stg->num_set++;
+      hash_key[slot] = key;
     }
+
+    node_set = &stg->set[hash_set[slot]];
+    stg->node[i].set_id = hash_set[slot];
+    node_set->set_size++;
+    if(stg->node[i].code[l] == '0')
+      node_set->num_zero++;
+    else if(stg->node[i].code[l] == '1')
+      node_set->num_one++;
+    else
+      node_set->num_unassigned++;
+  }
+
+  // counting sort of the nodes by set, keeping the node order
+  next[0] = 0;
+  for(k = 0; k < stg->num_set; k++) {
+    stg->set[k].node_list = stg->set_nodes + next[k];
+    next[k + 1] = next[k] + stg->set[k].set_size;
   }
+  for(i = 0; i < stg->num_node; i++)
+    stg->set_nodes[next[stg->node[i].set_id]++] = &stg->node[i];
+
+  for(i = 0; i < stg->num_set; i++)
+    stg->set[i].capacity = 1 << (stg->code_length - l - 1);
+
+  pow3_free(hash_set);
+  pow3_free(hash_key);
+  pow3_free(next);
+  return TRUE;
 }
 
 /************************************************
- update edge weights after each bit assignment
+ update edge weights after each bit assignment,
+ FALSE if out of memory
 *************************************************/
-void adjust_edge_weight(pow3_stg_t *stg)
+boolean adjust_edge_weight(pow3_stg_t *stg)
 {
   int i,j;
+  boolean ret_flag;
+  int *scale = NULL;
+
+  if((scale = (int *)pow3_malloc((stg->num_edge + 1) * sizeof(int))) == NULL)
+    return FALSE;
+
   for(i = 0; i < stg->num_node; i++)
-    for(j = 0; j < stg->num_node; j++)
-      stg->weight_matrix[i][j] *= hamming_distance(stg->node[i].code, stg->node[j].code, stg->code_length) +1;
-  
+    for(j = stg->adj_ptr[i]; j < stg->adj_ptr[i + 1]; j++)
+      stg->adj_weight[j] *= hamming_distance_bits(stg->node[i].code_bits, stg->node[stg->adj_node[j]].code_bits, stg->code_words) + 1;
+
   for(i = 0; i < stg->num_edge; i++) {
-    stg->edge_list[i]->weight *= hamming_distance(stg->edge_list[i]->n1->code, stg->edge_list[i]->n2->code, stg->code_length) + 1; 
+    scale[i] = hamming_distance_bits(stg->edge_list[i].n1->code_bits, stg->edge_list[i].n2->code_bits, stg->code_words) + 1;
+    stg->edge_list[i].weight *= scale[i];
   }
+
+  ret_flag = merge_edge(stg, scale, stg->code_length + 1);
+  pow3_free(scale);
+  return ret_flag;
 }
 
 /************************************************
-assign the state codes in STG to FSM
+assign the state codes in STG to FSM, FALSE if
+out of memory
 ************************************************/
-void update_fsm_code(pow3_stg_t *stg, fsm_t *fsm)
+boolean update_fsm_code(pow3_stg_t *stg, fsm_t *fsm)
 {
   int i;
   state_t *state;
 
   for(i = 0; i < stg->num_node; i++) {
     state = stg->node[i].state;
-    if(state->code != NULL)
-      free(state->code);
-    state->code = (char *)calloc(stg->code_length + 1, sizeof(char *));
-    strcpy(state->code, stg->node[i].code);
+    if(set_state_code(fsm, state, stg->node[i].code) == FALSE)
+      return FALSE;
   }
 
   fsm->code_length = stg->code_length;
-}
-
-void free_node(pow3_node_t *node)
-{
-  if(node->code)
-    free(node->code);
-}
-
-void free_set(pow3_set_t *set)
-{
-  int i;
-
-  if(set->node_list) 
-    free(set->node_list);
+  return pack_fsm_codes(fsm);
 }
 
 /**********************************
-free STG data structure
+free STG data structure, it goes
+away with its arena
 **********************************/
 void free_stg(pow3_stg_t *stg)
 {
-  int i;
-
-  if(stg->node) {
-    for(i = 0; i < stg->num_node; i++)
-      free_node(&stg->node[i]);
-    free(stg->node);
-  }
-
-  if(stg->edge_list) {
-    for(i = 0; i < stg->num_edge; i++)
-      free(stg->edge_list[i]);
-    free(stg->edge_list);
-  }
-  
-  if(stg->set) {
-    for(i = 0; i < stg->num_set; i++)
-      free_set(&stg->set[i]);
-    free(stg->set);
-  }
+  pow3_arena_t arena;
 
-  if(stg->weight_matrix) {
-    for(i = 0;i < stg->num_node; i++)
-      free(stg->weight_matrix[i]);
-    free(stg->weight_matrix);
-  }
-
-  free(stg);
+  if(stg == NULL)
+    return;
 
-  _pow3_stg = NULL;
+  arena = stg->arena;
+  free_arena(&arena);
 }
 
 /***********************************************
-main engine for POW3 encoding
+POW3 encoding with the total transition
+probabilities of the FSM already known
 ***********************************************/
-boolean encode_pow3(fsm_t *fsm)
+boolean encode_pow3_with_prob(fsm_t *fsm, csr_matrix_t *trans_prob)
 {
   int i;
+  boolean ret_flag = FALSE;
   pow3_stg_t *stg = NULL;
 
   // build STG based on input FSM
-  if(initialize_stg(fsm) == FALSE) {
-    printf("ERROR: cannot build STG.\n");
+  if((stg = initialize_stg(fsm, trans_prob)) == NULL) {
+    pow3_error(POW3_ERR_ENCODE, "ERROR: cannot build STG.\n");
     return FALSE;
   }
-  
-  stg = get_stg();
 
   // assign code to all the states bit by bit
   for(i = 0; i < fsm->code_length; i++) {
-    adjust_class_constr(stg);
+    if(adjust_class_constr(stg, i) == FALSE)
+      goto failure;
     assign(stg, i);
-    adjust_edge_weight(stg);
+    assign_rest(stg, i);
+    if(adjust_edge_weight(stg) == FALSE)
+      goto failure;
   }
 
   // return the code to FSM
-  update_fsm_code(stg, fsm);
+  ret_flag = update_fsm_code(stg, fsm);
 
+ failure:
   free_stg(stg);
 
-  return TRUE;
+  return ret_flag;
 }
 
+/***********************************************
+main engine for POW3 encoding
+***********************************************/
+boolean encode_pow3(fsm_t *fsm)
+{
+  boolean ret_flag;
+  csr_matrix_t *trans_prob = NULL;
 
+  if(fsm == NULL || (trans_prob = get_trans_prob_csr(fsm)) == NULL) {
+    pow3_error(POW3_ERR_ENCODE, "ERROR: cannot build STG.\n");
+    return FALSE;
+  }
 
+  ret_flag = encode_pow3_with_prob(fsm, trans_prob);
+  free_csr_matrix(trans_prob);
 
-
-
-
+  return ret_flag;
+}
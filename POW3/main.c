@@ -15,22 +15,44 @@ int main(int argc, char **argv)
   char *infile_name;
   char *outfile_name;
   char *temp_name;
+  char *input_name = NULL;
+  char *prob_name = NULL;
   double switching = 0;
+  int i;
   
-  infile_name = argv[1];
-
+  // -input weights the transitions by the input probabilities in the file,
+  // -prob takes the transition probabilities of a .prob or .bprob file instead
+  for(i = 1; i < argc - 1; i++) {
+    if(!strcmp(argv[i], "-input") && i < argc - 2)
+      input_name = argv[++i];
+    else if(!strcmp(argv[i], "-prob") && i < argc - 2)
+      prob_name = argv[++i];
+    else
+      break;
+  }
+  if(i != argc - 1) {
+    printf("Usage: %s [-input file | -prob file] <kiss2 file>\n", argv[0]);
+    exit(1);
+  }
+  infile_name = argv[i];
 
-  init_fsm();  
-  fsm = get_fsm();
+  fsm = init_fsm();
 
-  if(read_fsm_from_blif(infile_name, fsm) == FALSE) {
+  if(read_fsm_from_blif_mmap(infile_name, fsm) == FALSE) {
     printf("ERROR: Unable to build FSM for %s.\n", fsm->name);
-    free_fsm();
+    free_fsm(fsm);
+    exit(1);
+  }
+
+  if(input_name && read_input_prob(input_name, fsm) == FALSE) {
+    free_fsm(fsm);
     exit(1);
   }
 
   //print_fsm(fsm);
 
+  set_fsm_prob_file(fsm, prob_name);
+
   printf("Begin encoding for %s\n", fsm->name);  
   if(encode_pow3(fsm) == FALSE)
     exit(1);
@@ -43,7 +65,7 @@ int main(int argc, char **argv)
 
   free(temp_name);
   free(outfile_name);
-  free(fsm);
+  free_fsm(fsm);
 
   return 0;
 }
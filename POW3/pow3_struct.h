@@ -11,6 +11,8 @@ typedef struct pow3_node_struct {
   int index;
   int set_id;
   char *code;     // state code
+  uint64_t *code_bits; // packed code, unassigned bits are 0
+  uint64_t class_key;  // partial code before the current bit, 2 bits per position
   state_t *state; // link to the state in original FSM
 } pow3_node_t;
 
@@ -29,6 +31,10 @@ data structure for a set of nodes
 ***********************************/
 typedef struct pow3_set_struct {
   int set_size;
+  int capacity;       // max number of nodes sharing a value at this bit
+  int num_zero;       // nodes assigned 0 at the current bit
+  int num_one;        // nodes assigned 1 at the current bit
+  int num_unassigned; // nodes not yet assigned at the current bit
   pow3_node_t **node_list;
 } pow3_set_t;
  
@@ -40,9 +46,17 @@ typedef struct pow3_stg_struct {
   int num_node;
   int num_edge;
   int code_length;
+  int code_words;        // words per packed node code
+  uint64_t *code_block;  // storage of the packed node codes
   int num_set;
-  double **weight_matrix;
+  int *adj_ptr;       // neighbors of node i are adj_node[adj_ptr[i]..adj_ptr[i+1])
+  int *adj_node;
+  double *adj_weight; // weight of the edge to each neighbor
   pow3_node_t *node;
-  pow3_edge_t **edge_list;
+  pow3_edge_t *edge_list;   // kept in decreasing order of weights
+  pow3_edge_t *edge_buffer; // scratch space to merge the edge list
   pow3_set_t *set;
+  pow3_node_t **set_nodes; // node lists of all the sets, back to back
+  char *code_chars;        // code strings of all the nodes, back to back
+  pow3_arena_t arena;      // holds the STG itself and all its arrays
 } pow3_stg_t;
@@ -0,0 +1 @@
+../fsmToVerilog/global.h
\ No newline at end of file
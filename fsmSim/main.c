@@ -0,0 +1,189 @@
+/*
+ *
+ * Cycle accurate simulation of encoded FSMs on a
+ * recorded input trace. Every blif file given is
+ * simulated on the same trace in one pass over it,
+ * which makes the reports of several encodings of
+ * one FSM (POW3, brute force, annealing) directly
+ * comparable. With -mc the FSMs are run instead on
+ * SIM_LANES streams of random inputs, to check the
+ * Markov estimate of the switching activity.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include "struct.h"
+#include "global.h"
+#include "fsm.h"
+#include "context.h"
+#include "sim_struct.h"
+
+extern trace_t *open_trace(char *file_name, int num_input, boolean binary);
+extern void close_trace(trace_t *trace);
+extern int read_trace_block(trace_t *trace, uint32_t *input, int max_vector);
+extern sim_table_t *build_sim_table(fsm_t *fsm);
+extern void free_sim_table(sim_table_t *table);
+extern sim_report_t *init_sim_report(sim_table_t *table);
+extern void free_sim_report(sim_report_t *report);
+extern void simulate_block(sim_table_t *table, sim_report_t *report, uint32_t *input, int num_vector);
+extern void finish_sim_report(sim_table_t *table, sim_report_t *report);
+extern void print_sim_report(sim_table_t *table, sim_report_t *report);
+extern sim_lanes_t *init_sim_lanes(sim_table_t *table, uint64_t seed);
+extern void free_sim_lanes(sim_lanes_t *lanes);
+extern void simulate_lanes(sim_table_t *table, sim_report_t *report, sim_lanes_t *lanes, long long num_step);
+extern boolean get_switching_activity(fsm_t *fsm, double *total_sw, boolean print_prob);
+
+void print_usage(char *name)
+{
+  printf("Usage: %s [-b] <trace file | -> <encoded blif file> ...\n", name);
+  printf("       %s -mc cycles [-seed n] <encoded blif file> ...\n", name);
+}
+
+double get_elapsed(struct timespec *start_time)
+{
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start_time->tv_sec) + (now.tv_nsec - start_time->tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+  int i, arg = 1;
+  int num_fsm, num_vector = 0;
+  int exit_code = 1;
+  boolean binary = FALSE;
+  long long num_mc = 0;
+  uint64_t seed = 1;
+  double *markov = NULL;
+  char *trace_name = NULL;
+  fsm_t **fsm = NULL;
+  sim_table_t **table = NULL;
+  sim_report_t **report = NULL;
+  sim_lanes_t *lanes = NULL;
+  state_t *state;
+  trace_t *trace = NULL;
+  uint32_t *input = NULL;
+  struct timespec start_time;
+
+  // -b reads a binary trace, -mc runs random inputs for that many cycles
+  while(arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0') {
+    if(!strcmp(argv[arg], "-b"))
+      binary = TRUE;
+    else if(!strcmp(argv[arg], "-mc") && arg + 1 < argc)
+      num_mc = atoll(argv[++arg]);
+    else if(!strcmp(argv[arg], "-seed") && arg + 1 < argc)
+      seed = strtoull(argv[++arg], NULL, 10);
+    else {
+      print_usage(argv[0]);
+      exit(1);
+    }
+    arg++;
+  }
+  if(num_mc == 0 && arg < argc)
+    trace_name = argv[arg++];
+  if(arg >= argc || (num_mc == 0 && trace_name == NULL) || num_mc < 0) {
+    print_usage(argv[0]);
+    exit(1);
+  }
+  num_fsm = argc - arg;
+
+  fsm = (fsm_t **)calloc(num_fsm, sizeof(fsm_t *));
+  table = (sim_table_t **)calloc(num_fsm, sizeof(sim_table_t *));
+  report = (sim_report_t **)calloc(num_fsm, sizeof(sim_report_t *));
+  markov = (double *)calloc(num_fsm, sizeof(double));
+  input = (uint32_t *)malloc(SIM_BLOCK * sizeof(uint32_t));
+  if(fsm == NULL || table == NULL || report == NULL || markov == NULL || input == NULL) {
+    printf("ERROR: out of memory.\n");
+    goto failure;
+  }
+
+  for(i = 0; i < num_fsm; i++) {
+    fsm[i] = init_fsm();
+    if(read_fsm_from_blif_mmap(argv[arg + i], fsm[i]) == FALSE) {
+      printf("ERROR: Unable to read FSM from the input blif file %s.\n", argv[arg + i]);
+      goto failure;
+    }
+    for(state = fsm[i]->state; state < fsm[i]->state + fsm[i]->num_state; state++) {
+      if(state->code == NULL || state->code_bits == NULL) {
+	printf("ERROR: state %s of %s has no code, the FSM must be encoded.\n", state->name, argv[arg + i]);
+	goto failure;
+      }
+    }
+    // the FSMs share the trace
+    if(num_mc == 0 && fsm[i]->num_input != fsm[0]->num_input) {
+      printf("ERROR: %s has %d inputs, %s has %d.\n", argv[arg + i], fsm[i]->num_input, argv[arg], fsm[0]->num_input);
+      goto failure;
+    }
+    if((table[i] = build_sim_table(fsm[i])) == NULL || (report[i] = init_sim_report(table[i])) == NULL)
+      goto failure;
+  }
+
+  // Monte-Carlo: every FSM on its own lanes, next to its Markov estimate
+  for(i = 0; num_mc > 0 && i < num_fsm; i++) {
+    if((lanes = init_sim_lanes(table[i], seed)) == NULL)
+      goto failure;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    simulate_lanes(table[i], report[i], lanes, (num_mc + SIM_LANES - 1) / SIM_LANES);
+    report[i]->time = get_elapsed(&start_time);
+    free_sim_lanes(lanes);
+    lanes = NULL;
+    if(get_switching_activity(fsm[i], &markov[i], FALSE) == FALSE)
+      goto failure;
+  }
+
+  if(num_mc == 0 && (trace = open_trace(trace_name, fsm[0]->num_input, binary)) == NULL)
+    goto failure;
+
+  while(trace && (num_vector = read_trace_block(trace, input, SIM_BLOCK)) > 0) {
+    for(i = 0; i < num_fsm; i++) {
+      clock_gettime(CLOCK_MONOTONIC, &start_time);
+      simulate_block(table[i], report[i], input, num_vector);
+      report[i]->time += get_elapsed(&start_time);
+    }
+  }
+  if(num_vector < 0)
+    goto failure;
+
+  for(i = 0; i < num_fsm; i++) {
+    finish_sim_report(table[i], report[i]);
+    print_sim_report(table[i], report[i]);
+    if(num_mc > 0)
+      printf("Markov estimate:           %.4f per cycle\n", markov[i]);
+  }
+
+  // one line per encoding to compare them
+  if(num_fsm > 1) {
+    printf("-----------------------------------------------\n");
+    printf("%-24s %12s %6s %12s\n", "FSM", "toggles/cyc", "peak", num_mc > 0 ? "markov" : "out/cyc");
+    for(i = 0; i < num_fsm; i++)
+      printf("%-24s %12.4f %6d %12.4f\n", argv[arg + i], report[i]->state_toggles / (double)(report[i]->num_cycle > 0 ? report[i]->num_cycle : 1),
+	     report[i]->peak_toggles, num_mc > 0 ? markov[i] : report[i]->output_toggles / (double)(report[i]->num_cycle > 0 ? report[i]->num_cycle : 1));
+  }
+  printf("-----------------------------------------------\n");
+
+  exit_code = 0;
+
+ failure:
+  free_sim_lanes(lanes);
+  close_trace(trace);
+  for(i = 0; i < num_fsm; i++) {
+    if(report && report[i])
+      free_sim_report(report[i]);
+    if(table && table[i])
+      free_sim_table(table[i]);
+    if(fsm && fsm[i])
+      free_fsm(fsm[i]);
+  }
+  free(fsm);
+  free(table);
+  free(report);
+  free(markov);
+  free(input);
+
+  return exit_code;
+}
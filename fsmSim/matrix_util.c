@@ -0,0 +1 @@
+../fsmSwitching/matrix_util.c
\ No newline at end of file
@@ -0,0 +1,508 @@
+/*
+ * Transition probabilities learned from traces.
+ * A state trace (one state per cycle, as dumped by
+ * a simulation of the design) is memory mapped and
+ * cut into pieces at line or record boundaries, every
+ * piece counted by its own thread into its own table
+ * of transition counts; the tables are then merged
+ * and the transitions across the cuts added. An input
+ * trace is streamed through the next state table of
+ * the FSM instead, one cycle after the other. The
+ * counts over the total number of transitions are
+ * the total transition probabilities of a .prob file.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "struct.h"
+#include "global.h"
+#include "fsm.h"
+#include "context.h"
+#include "matrix_util.h"
+#include "sim_struct.h"
+
+extern trace_t *open_trace(char *file_name, int num_input, boolean binary);
+extern void close_trace(trace_t *trace);
+extern int read_trace_block(trace_t *trace, uint32_t *input, int max_vector);
+extern sim_table_t *build_sim_table(fsm_t *fsm);
+extern void free_sim_table(sim_table_t *table);
+
+/*************** begin forward function proto declaration *************/
+boolean init_trans_count(trans_count_t *counts, int num_state, int size);
+void free_trans_count(trans_count_t *counts);
+boolean add_trans_count(trans_count_t *counts, int from, int to, long long n);
+long long find_trans_count(trans_count_t *counts, int from, int to);
+boolean merge_trans_count(trans_count_t *counts, trans_count_t *other);
+int get_state_record_size(fsm_t *fsm);
+void *profile_chunk(void *arg);
+boolean profile_state_trace(fsm_t *fsm, char *file_name, boolean binary, int num_thread, trans_count_t *counts);
+boolean profile_input_trace(fsm_t *fsm, char *file_name, boolean binary, trans_count_t *counts);
+int compare_key(const void *a, const void *b);
+csr_matrix_t *get_profile_prob(fsm_t *fsm, trans_count_t *counts);
+/*************** end forward function proto declaration **************/
+
+/*******************************************
+the slot of a key, multiplicative hashing
+********************************************/
+#define COUNT_SLOT(key, size)  ((int)(((key) * 0x9E3779B97F4A7C15ULL) >> 32) & ((size) - 1))
+
+boolean init_trans_count(trans_count_t *counts, int num_state, int size)
+{
+  counts->num_state = num_state;
+  counts->size = 16;
+  while(counts->size < size)
+    counts->size <<= 1;
+  counts->num_key = 0;
+  counts->key = (uint64_t *)pow3_calloc(counts->size, sizeof(uint64_t));
+  counts->count = (long long *)pow3_calloc(counts->size, sizeof(long long));
+  if(counts->key == NULL || counts->count == NULL) {
+    free_trans_count(counts);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+void free_trans_count(trans_count_t *counts)
+{
+  pow3_free(counts->key);
+  pow3_free(counts->count);
+  counts->key = NULL;
+  counts->count = NULL;
+  counts->size = 0;
+  counts->num_key = 0;
+}
+
+/*******************************************
+n more transitions from -> to. the table
+doubles once it is half full
+********************************************/
+boolean add_trans_count(trans_count_t *counts, int from, int to, long long n)
+{
+  int i, slot;
+  uint64_t key = (uint64_t)from * counts->num_state + to + 1;
+  trans_count_t bigger;
+
+  slot = COUNT_SLOT(key, counts->size);
+  while(counts->key[slot] != 0 && counts->key[slot] != key)
+    slot = (slot + 1) & (counts->size - 1);
+  if(counts->key[slot] == key) {
+    counts->count[slot] += n;
+    return TRUE;
+  }
+
+  if(2 * (counts->num_key + 1) > counts->size) {
+    if(init_trans_count(&bigger, counts->num_state, 2 * counts->size) == FALSE)
+      return FALSE;
+    for(i = 0; i < counts->size; i++) {
+      if(counts->key[i] == 0)
+	continue;
+      slot = COUNT_SLOT(counts->key[i], bigger.size);
+      while(bigger.key[slot] != 0)
+	slot = (slot + 1) & (bigger.size - 1);
+      bigger.key[slot] = counts->key[i];
+      bigger.count[slot] = counts->count[i];
+    }
+    bigger.num_key = counts->num_key;
+    free_trans_count(counts);
+    *counts = bigger;
+
+    slot = COUNT_SLOT(key, counts->size);
+    while(counts->key[slot] != 0)
+      slot = (slot + 1) & (counts->size - 1);
+  }
+
+  counts->key[slot] = key;
+  counts->count[slot] = n;
+  counts->num_key++;
+
+  return TRUE;
+}
+
+long long find_trans_count(trans_count_t *counts, int from, int to)
+{
+  uint64_t key = (uint64_t)from * counts->num_state + to + 1;
+  int slot = COUNT_SLOT(key, counts->size);
+
+  while(counts->key[slot] != 0 && counts->key[slot] != key)
+    slot = (slot + 1) & (counts->size - 1);
+
+  return counts->key[slot] == key ? counts->count[slot] : 0;
+}
+
+boolean merge_trans_count(trans_count_t *counts, trans_count_t *other)
+{
+  int i, from, to;
+
+  for(i = 0; i < other->size; i++) {
+    if(other->key[i] == 0)
+      continue;
+    from = (other->key[i] - 1) / other->num_state;
+    to = (other->key[i] - 1) % other->num_state;
+    if(add_trans_count(counts, from, to, other->count[i]) == FALSE)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/*******************************************
+bytes per state of a binary state trace,
+just enough for the state index
+********************************************/
+int get_state_record_size(fsm_t *fsm)
+{
+  return (fsm->code_length + 7) / 8 > 0 ? (fsm->code_length + 7) / 8 : 1;
+}
+
+/*******************************************
+count the transitions of one piece of a
+state trace. a text trace has the name of
+a state as the first word of a line, blank
+lines and text after '#' are skipped; a
+binary trace has the state index, little
+endian, in record_size bytes per cycle. the
+thread works in the context of the caller
+********************************************/
+void *profile_chunk(void *arg)
+{
+  profile_chunk_t *chunk = (profile_chunk_t *)arg;
+  fsm_t *fsm = chunk->fsm;
+  char *p, *line_end, *name_end;
+  char *last_name = NULL;
+  char name[PROFILE_MAX_NAME + 1];
+  unsigned char *record;
+  int b, len, cur, prev = UNDEFINE;
+  int last_len = 0;
+  state_t *state;
+  pow3_ctx_t *prev_ctx = enter_context(chunk->ctx);
+
+  chunk->first_state = UNDEFINE;
+  chunk->last_state = UNDEFINE;
+
+  for(p = chunk->begin; p < chunk->end; ) {
+    if(chunk->binary) {
+      record = (unsigned char *)p;
+      cur = 0;
+      for(b = 0; b < chunk->record_size; b++)
+	cur |= (int)((uint32_t)record[b] << (8 * b));
+      if(cur < 0 || cur >= fsm->num_state) {
+	pow3_error(POW3_ERR_PARSE, "ERROR: state index %d at byte %lld of the trace, the FSM has %d states.\n", cur, (long long)(p - chunk->map), fsm->num_state);
+	chunk->error = TRUE;
+	goto done;
+      }
+      p += chunk->record_size;
+    }
+    else {
+      if((line_end = (char *)memchr(p, '\n', chunk->end - p)) == NULL)
+	line_end = chunk->end;
+      while(p < line_end && (*p == ' ' || *p == '\t' || *p == '\r'))
+	p++;
+      for(name_end = p; name_end < line_end && *name_end != ' ' && *name_end != '\t' && *name_end != '\r' && *name_end != '#'; name_end++);
+      len = name_end - p;
+      if(len == 0) {
+	p = line_end + 1;
+	continue;
+      }
+      // a state held for several cycles is looked up once
+      if(len == last_len && !memcmp(p, last_name, len)) {
+	cur = prev;
+	p = line_end + 1;
+	goto count;
+      }
+      if(len > PROFILE_MAX_NAME) {
+	pow3_error(POW3_ERR_PARSE, "ERROR: state name at byte %lld of the trace is too long.\n", (long long)(p - chunk->map));
+	chunk->error = TRUE;
+	goto done;
+      }
+      memcpy(name, p, len);
+      name[len] = '\0';
+      if(get_state(fsm, name, &state) == FALSE) {
+	pow3_error(POW3_ERR_PARSE, "ERROR: unknown state %s at byte %lld of the trace.\n", name, (long long)(p - chunk->map));
+	chunk->error = TRUE;
+	goto done;
+      }
+      cur = state->index;
+      last_name = p;
+      last_len = len;
+      p = line_end + 1;
+    }
+
+  count:
+    if(prev == UNDEFINE)
+      chunk->first_state = cur;
+    else if(chunk->dense)
+      chunk->dense[(size_t)prev * fsm->num_state + cur]++;
+    else if(add_trans_count(&chunk->counts, prev, cur, 1) == FALSE) {
+      chunk->error = TRUE;
+      goto done;
+    }
+    prev = cur;
+    chunk->num_record++;
+  }
+  chunk->last_state = prev;
+
+ done:
+  leave_context(prev_ctx);
+  return NULL;
+}
+
+/*******************************************
+transition counts of a state trace, counted
+on num_thread threads. a small FSM is
+counted in a dense matrix per thread
+********************************************/
+boolean profile_state_trace(fsm_t *fsm, char *file_name, boolean binary, int num_thread, trans_count_t *counts)
+{
+  int t, prev, from, to;
+  int n = fsm->num_state;
+  int fd = -1;
+  int record_size = get_state_record_size(fsm);
+  struct stat file_stat;
+  char *map = NULL;
+  char *end, *cut;
+  long long num_record = 0;
+  profile_chunk_t *chunk = NULL;
+  pthread_t *thread = NULL;
+  boolean ret_flag = FALSE;
+
+  if((fd = open(file_name, O_RDONLY)) < 0 || fstat(fd, &file_stat) < 0) {
+    pow3_error(POW3_ERR_IO, "ERROR: Cannot open trace file %s\n", file_name);
+    if(fd >= 0)
+      close(fd);
+    return FALSE;
+  }
+  if(file_stat.st_size > 0) {
+    map = (char *)mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED) {
+      pow3_error(POW3_ERR_IO, "ERROR: Cannot map trace file %s\n", file_name);
+      close(fd);
+      return FALSE;
+    }
+    madvise(map, file_stat.st_size, MADV_SEQUENTIAL);
+  }
+  end = map + file_stat.st_size;
+
+  if(binary && file_stat.st_size % record_size != 0)
+    pow3_log("Warning: %d bytes at the end of the trace are not a whole state.\n", (int)(file_stat.st_size % record_size));
+  if(binary)
+    end -= file_stat.st_size % record_size;
+
+  // small traces are not worth a thread per core
+  if(num_thread > file_stat.st_size / PROFILE_MIN_CHUNK + 1)
+    num_thread = file_stat.st_size / PROFILE_MIN_CHUNK + 1;
+  if(num_thread < 1)
+    num_thread = 1;
+
+  chunk = (profile_chunk_t *)pow3_calloc(num_thread, sizeof(profile_chunk_t));
+  thread = (pthread_t *)pow3_calloc(num_thread, sizeof(pthread_t));
+  if(chunk == NULL || thread == NULL)
+    goto failure;
+
+  // a line belongs to the piece holding its first byte
+  for(t = 0; t < num_thread; t++) {
+    chunk[t].ctx = get_context();
+    chunk[t].fsm = fsm;
+    chunk[t].binary = binary;
+    chunk[t].record_size = record_size;
+    chunk[t].map = map;
+    cut = map + (end - map) / num_thread * t;
+    if(binary)
+      cut = map + (cut - map) / record_size * record_size;
+    else if(t > 0 && (cut = (char *)memchr(cut - 1, '\n', end - cut + 1)) == NULL)
+      cut = end;
+    else if(t > 0)
+      cut++;
+    chunk[t].begin = t > 0 && cut < chunk[t - 1].begin ? chunk[t - 1].begin : cut;
+    if(t > 0)
+      chunk[t - 1].end = chunk[t].begin;
+    if(init_trans_count(&chunk[t].counts, n, 4 * fsm->num_transition) == FALSE)
+      goto failure;
+    if((size_t)n * n <= PROFILE_MAX_DENSE && (chunk[t].dense = (long long *)pow3_calloc((size_t)n * n + 1, sizeof(long long))) == NULL)
+      goto failure;
+  }
+  chunk[num_thread - 1].end = end;
+
+  for(t = 0; t < num_thread; t++)
+    pthread_create(&thread[t], NULL, profile_chunk, &chunk[t]);
+  for(t = 0; t < num_thread; t++)
+    pthread_join(thread[t], NULL);
+
+  // the pieces, and the transitions across their cuts
+  prev = UNDEFINE;
+  for(t = 0; t < num_thread; t++) {
+    if(chunk[t].error || merge_trans_count(counts, &chunk[t].counts) == FALSE)
+      goto failure;
+    for(from = 0; chunk[t].dense && from < n; from++)
+      for(to = 0; to < n; to++)
+	if(chunk[t].dense[(size_t)from * n + to] > 0 && add_trans_count(counts, from, to, chunk[t].dense[(size_t)from * n + to]) == FALSE)
+	  goto failure;
+    if(chunk[t].first_state == UNDEFINE)
+      continue;
+    if(prev != UNDEFINE && add_trans_count(counts, prev, chunk[t].first_state, 1) == FALSE)
+      goto failure;
+    prev = chunk[t].last_state;
+    num_record += chunk[t].num_record;
+  }
+
+  pow3_log("State trace %s: %lld cycles on %d threads.\n", file_name, num_record, num_thread);
+  ret_flag = TRUE;
+
+ failure:
+  for(t = 0; chunk && t < num_thread; t++) {
+    free_trans_count(&chunk[t].counts);
+    pow3_free(chunk[t].dense);
+  }
+  pow3_free(chunk);
+  pow3_free(thread);
+  if(map)
+    munmap(map, file_stat.st_size);
+  close(fd);
+
+  return ret_flag;
+}
+
+/*******************************************
+transition counts of an input trace, run
+through the FSM from its reset state. a
+cycle whose input is not specified for the
+state keeps the state, as in simulate_fsm
+********************************************/
+boolean profile_input_trace(fsm_t *fsm, char *file_name, boolean binary, trans_count_t *counts)
+{
+  int c, s, t, num_vector;
+  int base;
+  int *entry, *next_base;
+  long long num_cycle = 0;
+  long long *hits = NULL;
+  long long *held = NULL;
+  uint32_t *input = NULL;
+  sim_table_t *table = NULL;
+  trace_t *trace = NULL;
+  boolean ret_flag = FALSE;
+
+  if((table = build_sim_table(fsm)) == NULL || (trace = open_trace(file_name, fsm->num_input, binary)) == NULL)
+    goto failure;
+
+  hits = (long long *)pow3_calloc(fsm->num_transition + 1, sizeof(long long));
+  held = (long long *)pow3_calloc(fsm->num_state + 1, sizeof(long long));
+  input = (uint32_t *)pow3_malloc(SIM_BLOCK * sizeof(uint32_t));
+  if(hits == NULL || held == NULL || input == NULL)
+    goto failure;
+
+  entry = table->entry;
+  next_base = table->next_base;
+  base = table->init_state << table->num_input;
+  while((num_vector = read_trace_block(trace, input, SIM_BLOCK)) > 0) {
+    for(c = 0; c < num_vector; c++) {
+      t = entry[base | input[c]];
+      if(t == 0) {
+	held[base >> table->num_input]++;
+	continue;
+      }
+      hits[t]++;
+      base = next_base[t];
+    }
+    num_cycle += num_vector;
+  }
+  if(num_vector < 0)
+    goto failure;
+
+  for(t = 1; t <= fsm->num_transition; t++)
+    if(hits[t] > 0 && add_trans_count(counts, fsm->transition[t - 1].current_state->index, fsm->transition[t - 1].next_state->index, hits[t]) == FALSE)
+      goto failure;
+  for(s = 0; s < fsm->num_state; s++)
+    if(held[s] > 0 && add_trans_count(counts, s, s, held[s]) == FALSE)
+      goto failure;
+
+  pow3_log("Input trace %s: %lld cycles.\n", file_name, num_cycle);
+  ret_flag = TRUE;
+
+ failure:
+  close_trace(trace);
+  free_sim_table(table);
+  pow3_free(hits);
+  pow3_free(held);
+  pow3_free(input);
+
+  return ret_flag;
+}
+
+int compare_key(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/*******************************************
+the counts over their total, the total
+transition probabilities with the columns
+of every row in order. transitions the STG
+does not have are reported
+********************************************/
+csr_matrix_t *get_profile_prob(fsm_t *fsm, trans_count_t *counts)
+{
+  int i, k, from, to;
+  int n = fsm->num_state;
+  long long total = 0, num_other = 0;
+  uint64_t *key = NULL;
+  trans_count_t stg;
+  csr_matrix_t *trans_prob = NULL;
+
+  if(init_trans_count(&stg, n, 2 * fsm->num_transition) == FALSE)
+    return NULL;
+  for(i = 0; i < fsm->num_transition; i++)
+    if(add_trans_count(&stg, fsm->transition[i].current_state->index, fsm->transition[i].next_state->index, 1) == FALSE)
+      goto failure;
+
+  if((key = (uint64_t *)pow3_malloc((counts->num_key + 1) * sizeof(uint64_t))) == NULL)
+    goto failure;
+  for(i = 0, k = 0; i < counts->size; i++) {
+    if(counts->key[i] == 0)
+      continue;
+    key[k++] = counts->key[i];
+    total += counts->count[i];
+  }
+  if(total == 0) {
+    pow3_error(POW3_ERR_ARGUMENT, "ERROR: the trace has no transitions.\n");
+    goto failure;
+  }
+  qsort(key, counts->num_key, sizeof(uint64_t), compare_key);
+
+  if((trans_prob = alloc_csr_matrix(n, n, counts->num_key)) == NULL)
+    goto failure;
+  for(k = 0; k < counts->num_key; k++) {
+    from = (key[k] - 1) / n;
+    to = (key[k] - 1) % n;
+    trans_prob->row_ptr[from + 1]++;
+    trans_prob->col_idx[k] = to;
+    trans_prob->val[k] = (double)find_trans_count(counts, from, to) / total;
+    if(from != to && find_trans_count(&stg, from, to) == 0) {
+      if(num_other == 0)
+	pow3_log("Warning: the trace goes from state %s to %s, which the FSM cannot.\n", fsm->state[from].name, fsm->state[to].name);
+      num_other += find_trans_count(counts, from, to);
+    }
+  }
+  for(i = 0; i < n; i++)
+    trans_prob->row_ptr[i + 1] += trans_prob->row_ptr[i];
+  trans_prob->num_nz = counts->num_key;
+
+  if(num_other > 0)
+    pow3_log("Warning: %lld of %lld transitions of the trace are not in the FSM.\n", num_other, total);
+  pow3_log("%lld transitions, %d of them distinct.\n", total, counts->num_key);
+
+ failure:
+  free_trans_count(&stg);
+  pow3_free(key);
+
+  return trans_prob;
+}
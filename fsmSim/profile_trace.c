@@ -0,0 +1,139 @@
+/*
+ *
+ * Learn the transition probabilities of a FSM from
+ * a trace and write them as a .prob file, the same
+ * layout report_switching writes (.bprob with
+ * -binary), for pow3 -prob.
+ * The trace is a state trace by default, the state
+ * of every cycle; with -input it is an input trace
+ * as simulate_fsm reads it, run through the FSM.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "struct.h"
+#include "global.h"
+#include "fsm.h"
+#include "context.h"
+#include "matrix_util.h"
+#include "sim_struct.h"
+
+extern boolean init_trans_count(trans_count_t *counts, int num_state, int size);
+extern void free_trans_count(trans_count_t *counts);
+extern boolean profile_state_trace(fsm_t *fsm, char *file_name, boolean binary, int num_thread, trans_count_t *counts);
+extern boolean profile_input_trace(fsm_t *fsm, char *file_name, boolean binary, trans_count_t *counts);
+extern csr_matrix_t *get_profile_prob(fsm_t *fsm, trans_count_t *counts);
+extern boolean write_trans_prob(char *file_name, csr_matrix_t *trans_prob);
+extern void set_prob_format(int format);
+
+void print_usage(char *name)
+{
+  printf("Usage: %s [-b] [-t threads] [-binary] [-o prob file] <state trace> <kiss2 or blif file>\n", name);
+  printf("       %s -input [-b] [-binary] [-o prob file] <input trace | -> <kiss2 or blif file>\n", name);
+}
+
+int main(int argc, char **argv)
+{
+  int arg = 1;
+  int num_thread = 0;
+  int exit_code = 1;
+  boolean binary = FALSE;
+  boolean input_trace = FALSE;
+  boolean success;
+  char *trace_name, *fsm_name;
+  char *prob_name = NULL;
+  char *file_name = NULL;
+  double elapsed;
+  fsm_t *fsm = NULL;
+  trans_count_t counts;
+  csr_matrix_t *trans_prob = NULL;
+  struct timespec start_time, end_time;
+  struct stat trace_stat;
+
+  // -b reads a binary trace, -input a trace of inputs instead of states,
+  // -binary writes a sparse .bprob file
+  while(arg < argc && argv[arg][0] == '-' && argv[arg][1] != '\0') {
+    if(!strcmp(argv[arg], "-b"))
+      binary = TRUE;
+    else if(!strcmp(argv[arg], "-input"))
+      input_trace = TRUE;
+    else if(!strcmp(argv[arg], "-binary"))
+      set_prob_format(PROB_BINARY);
+    else if(!strcmp(argv[arg], "-t") && arg + 1 < argc)
+      num_thread = atoi(argv[++arg]);
+    else if(!strcmp(argv[arg], "-o") && arg + 1 < argc)
+      prob_name = argv[++arg];
+    else {
+      print_usage(argv[0]);
+      exit(1);
+    }
+    arg++;
+  }
+  if(argc - arg != 2) {
+    print_usage(argv[0]);
+    exit(1);
+  }
+  trace_name = argv[arg];
+  fsm_name = argv[arg + 1];
+  // a state trace is memory mapped, only an input trace is streamed
+  if(input_trace == FALSE && !strcmp(trace_name, "-")) {
+    printf("ERROR: a state trace is read from a file, only an input trace (-input) from the standard input.\n");
+    exit(1);
+  }
+
+  if(num_thread < 1)
+    num_thread = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if(num_thread < 1)
+    num_thread = 1;
+
+  fsm = init_fsm();
+  if(read_fsm_from_blif_mmap(fsm_name, fsm) == FALSE) {
+    printf("ERROR: Unable to read FSM from %s.\n", fsm_name);
+    free_fsm(fsm);
+    exit(1);
+  }
+  if(init_trans_count(&counts, fsm->num_state, 4 * fsm->num_transition) == FALSE) {
+    free_fsm(fsm);
+    exit(1);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  if(input_trace)
+    success = profile_input_trace(fsm, trace_name, binary, &counts);
+  else
+    success = profile_state_trace(fsm, trace_name, binary, num_thread, &counts);
+  clock_gettime(CLOCK_MONOTONIC, &end_time);
+  if(success == FALSE || (trans_prob = get_profile_prob(fsm, &counts)) == NULL)
+    goto failure;
+
+  elapsed = (end_time.tv_sec - start_time.tv_sec) + (end_time.tv_nsec - start_time.tv_nsec) / 1e9;
+  if(stat(trace_name, &trace_stat) == 0 && elapsed > 0)
+    printf("Profiled %.1f MB in %.2f seconds, %.1f MB/s\n", trace_stat.st_size / 1e6, elapsed, trace_stat.st_size / 1e6 / elapsed);
+
+  if(prob_name == NULL) {
+    if((file_name = (char *)calloc(strlen(fsm->name) + 7, sizeof(char))) == NULL)
+      goto failure;
+    sprintf(file_name, "%s.%s", fsm->name, get_context()->prob_format == PROB_BINARY ? "bprob" : "prob");
+    prob_name = file_name;
+  }
+  if(write_trans_prob(prob_name, trans_prob) == FALSE)
+    goto failure;
+  printf("Transition probabilities of %s written to %s\n", fsm->name, prob_name);
+
+  exit_code = 0;
+
+ failure:
+  if(trans_prob)
+    free_csr_matrix(trans_prob);
+  free_trans_count(&counts);
+  free_fsm(fsm);
+  free(file_name);
+
+  return exit_code;
+}
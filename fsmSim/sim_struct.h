@@ -0,0 +1,136 @@
+/*
+ * The Data Structures used in the cycle
+ * accurate simulation of an encoded FSM
+ * on an input trace
+ *
+ */
+
+#include <stdint.h>
+
+#define SIM_MAX_INPUT       24         // inputs of a dense next state table
+#define SIM_MAX_ENTRY       (1 << 25)  // entries of a dense next state table
+#define SIM_BLOCK           65536      // input vectors simulated at a time
+#define TRACE_BUFFER_SIZE   (1 << 20)
+#define SIM_LANES           64         // input streams of a Monte-Carlo run
+
+/**********************************
+an input trace, read a buffer at a
+time. a text trace has one vector
+per line, input k as the k-th 0/1
+character; a binary trace has
+(num_input + 7) / 8 bytes per
+vector, input k in bit k
+**********************************/
+typedef struct trace_struct {
+  int fd;
+  boolean binary;
+  int num_input;
+  int record_size;        // bytes per vector of a binary trace
+  char *buffer;
+  int length;             // bytes in buffer
+  int pos;                // first byte not parsed yet
+  boolean eof;
+  long long line;         // lines read from a text trace
+  long long num_vector;
+} trace_t;
+
+/**********************************
+the FSM compiled for simulation.
+entry[(state << num_input) | input]
+is 1 + the transition taken, 0 if
+the input is not specified for the
+state. the arrays below are indexed
+by that same 1 + transition
+**********************************/
+typedef struct sim_table_struct {
+  fsm_t *fsm;
+  int num_input;
+  int code_length;
+  int out_words;
+  int init_state;
+  int *entry;
+  int *next_base;         // next state << num_input
+  int *toggles;           // state bits toggled
+  uint64_t *next_code;    // first word of the packed next state code
+  uint64_t *output;       // packed outputs, out_words each
+  int *spec_ptr;          // the entries of state s specified for some input
+  int *spec;              // are spec[spec_ptr[s]..spec_ptr[s+1])
+} sim_table_t;
+
+/**********************************
+what the simulation measured. the
+state stays, and the outputs hold,
+on an input not specified for it.
+the outputs and the cycle of the
+peaks are only known on a trace
+**********************************/
+typedef struct sim_report_struct {
+  boolean on_trace;
+  long long num_cycle;
+  long long *hits;                // cycles on each 1 + transition, [0] unspecified
+  long long state_toggles;
+  long long *bit_toggles;         // per code bit
+  int peak_toggles;
+  long long peak_cycle;
+  long long output_toggles;
+  long long *output_bit_toggles;  // per output
+  int peak_output_toggles;
+  long long peak_output_cycle;
+  int base;                       // current state << num_input
+  uint64_t *last_output;
+  double time;                    // seconds spent simulating
+} sim_report_t;
+
+/**********************************
+SIM_LANES independent streams of
+random inputs, uniform over those
+specified for the state, advanced
+together one cycle at a time. each
+lane has its own random generator
+and state
+**********************************/
+typedef struct sim_lanes_struct {
+  uint64_t seed[SIM_LANES];
+  int state[SIM_LANES];
+  uint64_t code[SIM_LANES];       // first word of its packed code
+} sim_lanes_t;
+
+#define PROFILE_MIN_CHUNK   (1 << 20)  // bytes of a state trace per thread at least
+#define PROFILE_MAX_NAME    256        // characters of a state name in a state trace
+#define PROFILE_MAX_DENSE   (1 << 18)  // states squared of a FSM counted in a dense matrix
+
+/**********************************
+how often each transition of a
+trace was seen, an open addressing
+table keyed by 1 + from * num_state
++ to, key 0 for an empty slot
+**********************************/
+typedef struct trans_count_struct {
+  int num_state;
+  int size;               // slots, a power of 2
+  int num_key;
+  uint64_t *key;
+  long long *count;
+} trans_count_t;
+
+/**********************************
+a piece of a memory mapped state
+trace, counted by one thread. its
+first and last state join it to
+the pieces before and after it
+**********************************/
+typedef struct profile_chunk_struct {
+  pow3_ctx_t *ctx;        // context of the caller, entered by the thread
+  fsm_t *fsm;
+  boolean binary;
+  int record_size;        // bytes per state of a binary trace
+  char *map;              // the whole trace, for the offsets of errors
+  char *begin;
+  char *end;
+  trans_count_t counts;
+  long long *dense;       // num_state x num_state counts of a small FSM, else NULL
+  int first_state;
+  int last_state;
+  long long num_record;
+  boolean error;
+} profile_chunk_t;
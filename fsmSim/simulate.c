@@ -0,0 +1,395 @@
+/*
+ * Cycle accurate simulation of an encoded FSM.
+ * The FSM is compiled into a dense table indexed
+ * by (state, packed input), so a cycle is one table
+ * lookup. The state bit toggles are counted per
+ * transition taken and expanded into per-bit counts
+ * at the end; the outputs are compared cycle by
+ * cycle. A Monte-Carlo run advances SIM_LANES
+ * independent random input streams together, so
+ * that the lookups of different lanes overlap.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "struct.h"
+#include "global.h"
+#include "fsm.h"
+#include "context.h"
+#include "sim_struct.h"
+
+/*************** begin forward function proto declaration *************/
+sim_table_t *build_sim_table(fsm_t *fsm);
+void free_sim_table(sim_table_t *table);
+sim_report_t *init_sim_report(sim_table_t *table);
+void free_sim_report(sim_report_t *report);
+void simulate_block(sim_table_t *table, sim_report_t *report, uint32_t *input, int num_vector);
+void finish_sim_report(sim_table_t *table, sim_report_t *report);
+void print_sim_report(sim_table_t *table, sim_report_t *report);
+sim_lanes_t *init_sim_lanes(sim_table_t *table, uint64_t seed);
+void free_sim_lanes(sim_lanes_t *lanes);
+void simulate_lanes(sim_table_t *table, sim_report_t *report, sim_lanes_t *lanes, long long num_step);
+/*************** end forward function proto declaration **************/
+
+/*******************************************
+compile a FSM into its next state table.
+the inputs covered by a transition cube are
+enumerated over its don't cares; where two
+cubes of a state overlap the first
+transition is taken. a FSM not encoded yet
+has no state toggles
+********************************************/
+sim_table_t *build_sim_table(fsm_t *fsm)
+{
+  int i, s, t, w;
+  int num_overlap = 0;
+  int init_flag;
+  size_t num_entry;
+  uint32_t mask, care, value, dont_care, sub;
+  trans_t *transition;
+  state_t *init_state;
+  sim_table_t *table = NULL;
+  boolean encoded = TRUE;
+
+  if(fsm->num_input > SIM_MAX_INPUT || ((size_t)fsm->num_state << fsm->num_input) > SIM_MAX_ENTRY) {
+    pow3_error(POW3_ERR_ARGUMENT, "ERROR: %d states of %d inputs are too many for a dense next state table.\n", fsm->num_state, fsm->num_input);
+    return NULL;
+  }
+  for(i = 0; i < fsm->num_state; i++)
+    if(fsm->state[i].code == NULL || fsm->state[i].code_bits == NULL)
+      encoded = FALSE;
+
+  if((table = (sim_table_t *)pow3_calloc(1, sizeof(sim_table_t))) == NULL)
+    return NULL;
+
+  table->fsm = fsm;
+  table->num_input = fsm->num_input;
+  table->code_length = fsm->num_state > 0 && encoded ? strlen(fsm->state[0].code) : 0;
+  table->out_words = NUM_WORDS(fsm->num_output) > 0 ? NUM_WORDS(fsm->num_output) : 1;
+  num_entry = (size_t)fsm->num_state << fsm->num_input;
+  table->entry = (int *)pow3_calloc(num_entry > 0 ? num_entry : 1, sizeof(int));
+  table->next_base = (int *)pow3_calloc(fsm->num_transition + 1, sizeof(int));
+  table->toggles = (int *)pow3_calloc(fsm->num_transition + 1, sizeof(int));
+  table->next_code = (uint64_t *)pow3_calloc(fsm->num_transition + 1, sizeof(uint64_t));
+  table->output = (uint64_t *)pow3_calloc((size_t)(fsm->num_transition + 1) * table->out_words, sizeof(uint64_t));
+  table->spec_ptr = (int *)pow3_calloc(fsm->num_state + 1, sizeof(int));
+  if(table->entry == NULL || table->next_base == NULL || table->toggles == NULL || table->next_code == NULL || table->output == NULL || table->spec_ptr == NULL) {
+    free_sim_table(table);
+    return NULL;
+  }
+
+  init_state = get_fsm_init_state(fsm, &init_flag);
+  if(init_flag == TRUE)
+    table->init_state = init_state->index;
+  else {
+    pow3_log("Warning: no reset state, the simulation starts in state %s.\n", fsm->state[0].name);
+    table->init_state = 0;
+  }
+
+  mask = fsm->num_input < 32 ? ((uint32_t)1 << fsm->num_input) - 1 : ~(uint32_t)0;
+  for(i = 0; i < fsm->num_transition; i++) {
+    transition = &fsm->transition[i];
+    t = i + 1;
+    s = transition->current_state->index;
+    table->next_base[t] = transition->next_state->index << fsm->num_input;
+    if(encoded) {
+      table->toggles[t] = hamming_distance_bits(transition->current_state->code_bits, transition->next_state->code_bits, fsm->code_words);
+      table->next_code[t] = transition->next_state->code_bits[0];
+    }
+    for(w = 0; w < NUM_WORDS(fsm->num_output); w++)
+      table->output[(size_t)t * table->out_words + w] = transition->out_cube.value[w];
+
+    care = fsm->num_input > 0 ? (uint32_t)transition->in_cube.care[0] & mask : 0;
+    value = fsm->num_input > 0 ? (uint32_t)transition->in_cube.value[0] & mask : 0;
+    dont_care = ~care & mask;
+
+    // every subset of the don't care inputs
+    sub = 0;
+    do {
+      if(table->entry[((size_t)s << fsm->num_input) | value | sub] == 0)
+	table->entry[((size_t)s << fsm->num_input) | value | sub] = t;
+      else
+	num_overlap++;
+      sub = (sub - dont_care) & dont_care;
+    } while(sub != 0);
+  }
+
+  if(num_overlap > 0)
+    pow3_log("Warning: %d inputs match more than one transition of their state, the first one is taken.\n", num_overlap);
+
+  // the specified entries of every state, packed
+  for(i = 0; i < (int)num_entry; i++)
+    if(table->entry[i] != 0)
+      table->spec_ptr[(i >> fsm->num_input) + 1]++;
+  for(s = 0; s < fsm->num_state; s++)
+    table->spec_ptr[s + 1] += table->spec_ptr[s];
+  if((table->spec = (int *)pow3_malloc((table->spec_ptr[fsm->num_state] + 1) * sizeof(int))) == NULL) {
+    free_sim_table(table);
+    return NULL;
+  }
+  for(i = 0, t = 0; i < (int)num_entry; i++)
+    if(table->entry[i] != 0)
+      table->spec[t++] = table->entry[i];
+
+  return table;
+}
+
+void free_sim_table(sim_table_t *table)
+{
+  if(table == NULL)
+    return;
+
+  pow3_free(table->entry);
+  pow3_free(table->next_base);
+  pow3_free(table->toggles);
+  pow3_free(table->next_code);
+  pow3_free(table->output);
+  pow3_free(table->spec_ptr);
+  pow3_free(table->spec);
+  pow3_free(table);
+}
+
+/*******************************************
+an empty report, the FSM in its reset state
+with all outputs 0
+********************************************/
+sim_report_t *init_sim_report(sim_table_t *table)
+{
+  sim_report_t *report = NULL;
+
+  if((report = (sim_report_t *)pow3_calloc(1, sizeof(sim_report_t))) == NULL)
+    return NULL;
+
+  report->hits = (long long *)pow3_calloc(table->fsm->num_transition + 1, sizeof(long long));
+  report->bit_toggles = (long long *)pow3_calloc(table->code_length + 1, sizeof(long long));
+  report->output_bit_toggles = (long long *)pow3_calloc((size_t)table->out_words * WORD_BITS, sizeof(long long));
+  report->last_output = (uint64_t *)pow3_calloc(table->out_words, sizeof(uint64_t));
+  if(report->hits == NULL || report->bit_toggles == NULL || report->output_bit_toggles == NULL || report->last_output == NULL) {
+    free_sim_report(report);
+    return NULL;
+  }
+
+  report->base = table->init_state << table->num_input;
+
+  return report;
+}
+
+void free_sim_report(sim_report_t *report)
+{
+  if(report == NULL)
+    return;
+
+  pow3_free(report->hits);
+  pow3_free(report->bit_toggles);
+  pow3_free(report->output_bit_toggles);
+  pow3_free(report->last_output);
+  pow3_free(report);
+}
+
+/*******************************************
+run num_vector cycles from where the report
+left off
+********************************************/
+void simulate_block(sim_table_t *table, sim_report_t *report, uint32_t *input, int num_vector)
+{
+  int c, t, w, toggles;
+  int base = report->base;
+  int peak_toggles = report->peak_toggles;
+  int peak_output_toggles = report->peak_output_toggles;
+  long long state_toggles = report->state_toggles;
+  long long output_toggles = report->output_toggles;
+  int out_words = table->out_words;
+  int *entry = table->entry;
+  int *next_base = table->next_base;
+  int *trans_toggles = table->toggles;
+  long long *hits = report->hits;
+  long long *output_bit_toggles = report->output_bit_toggles;
+  uint64_t *last_output = report->last_output;
+  uint64_t *output;
+  uint64_t diff;
+
+  for(c = 0; c < num_vector; c++) {
+    t = entry[base | input[c]];
+    hits[t]++;
+    if(t == 0)
+      continue;
+
+    state_toggles += trans_toggles[t];
+    if(trans_toggles[t] > peak_toggles) {
+      peak_toggles = trans_toggles[t];
+      report->peak_cycle = report->num_cycle + c;
+    }
+    base = next_base[t];
+
+    toggles = 0;
+    output = &table->output[(size_t)t * out_words];
+    for(w = 0; w < out_words; w++) {
+      diff = output[w] ^ last_output[w];
+      if(diff == 0)
+	continue;
+      toggles += POPCOUNT(diff);
+      last_output[w] = output[w];
+      while(diff) {
+	output_bit_toggles[w * WORD_BITS + __builtin_ctzll(diff)]++;
+	diff &= diff - 1;
+      }
+    }
+    output_toggles += toggles;
+    if(toggles > peak_output_toggles) {
+      peak_output_toggles = toggles;
+      report->peak_output_cycle = report->num_cycle + c;
+    }
+  }
+
+  report->on_trace = TRUE;
+  report->base = base;
+  report->peak_toggles = peak_toggles;
+  report->peak_output_toggles = peak_output_toggles;
+  report->state_toggles = state_toggles;
+  report->output_toggles = output_toggles;
+  report->num_cycle += num_vector;
+}
+
+/*******************************************
+state toggles per code bit, and their peak,
+from the cycles spent on every transition
+********************************************/
+void finish_sim_report(sim_table_t *table, sim_report_t *report)
+{
+  int i, k;
+  trans_t *transition;
+
+  for(k = 0; k < table->code_length; k++)
+    report->bit_toggles[k] = 0;
+
+  for(i = 0; i < table->fsm->num_transition; i++) {
+    if(report->hits[i + 1] == 0)
+      continue;
+    transition = &table->fsm->transition[i];
+    if(table->toggles[i + 1] > report->peak_toggles)
+      report->peak_toggles = table->toggles[i + 1];
+    for(k = 0; k < table->code_length; k++)
+      if(transition->current_state->code[k] != transition->next_state->code[k])
+	report->bit_toggles[k] += report->hits[i + 1];
+  }
+}
+
+void print_sim_report(sim_table_t *table, sim_report_t *report)
+{
+  int k;
+  double num_cycle = report->num_cycle > 0 ? (double)report->num_cycle : 1;
+
+  printf("-----------------------------------------------\n");
+  printf("Simulation of %s\n", table->fsm->name);
+  printf("-----------------------------------------------\n");
+  printf("Cycles:                    %lld\n", report->num_cycle);
+  printf("Unspecified cycles:        %lld\n", report->hits[0]);
+  printf("State bit toggles:         %lld (%.4f per cycle)\n", report->state_toggles, report->state_toggles / num_cycle);
+  for(k = 0; k < table->code_length; k++)
+    printf("  bit %-3d                  %lld (%.4f)\n", k, report->bit_toggles[k], report->bit_toggles[k] / num_cycle);
+  if(report->on_trace == FALSE) {
+    printf("Peak state toggles:        %d\n", report->peak_toggles);
+    if(report->time > 0)
+      printf("Simulation speed:          %.1f Mcycles/s\n", report->num_cycle / report->time / 1e6);
+    return;
+  }
+  printf("Peak state toggles:        %d at cycle %lld\n", report->peak_toggles, report->peak_cycle);
+  printf("Output toggles:            %lld (%.4f per cycle)\n", report->output_toggles, report->output_toggles / num_cycle);
+  for(k = 0; k < table->fsm->num_output; k++)
+    printf("  output %-3d               %lld (%.4f)\n", k, report->output_bit_toggles[k], report->output_bit_toggles[k] / num_cycle);
+  printf("Peak output toggles:       %d at cycle %lld\n", report->peak_output_toggles, report->peak_output_cycle);
+  if(report->time > 0)
+    printf("Simulation speed:          %.1f Mcycles/s\n", report->num_cycle / report->time / 1e6);
+}
+
+/*******************************************
+SIM_LANES lanes in the reset state, their
+generators seeded from seed and the lane
+********************************************/
+sim_lanes_t *init_sim_lanes(sim_table_t *table, uint64_t seed)
+{
+  int l;
+  uint64_t z;
+  sim_lanes_t *lanes = NULL;
+
+  if(table->code_length > WORD_BITS) {
+    pow3_error(POW3_ERR_ARGUMENT, "ERROR: codes of %d bits are too long for the lanes, at most %d.\n", table->code_length, WORD_BITS);
+    return NULL;
+  }
+
+  if((lanes = (sim_lanes_t *)pow3_calloc(1, sizeof(sim_lanes_t))) == NULL)
+    return NULL;
+
+  for(l = 0; l < SIM_LANES; l++) {
+    // splitmix64, never a zero state for xorshift
+    z = seed + (uint64_t)(l + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    lanes->seed[l] = z ? z : 1;
+    lanes->state[l] = table->init_state;
+    lanes->code[l] = table->fsm->state[table->init_state].code_bits[0];
+  }
+
+  return lanes;
+}
+
+void free_sim_lanes(sim_lanes_t *lanes)
+{
+  if(lanes == NULL)
+    return;
+
+  pow3_free(lanes);
+}
+
+/*******************************************
+advance every lane num_step cycles. the
+lanes are independent, so the table lookups
+of one cycle do not wait on each other. the
+input is drawn among those specified for
+the state, as the Markov model only weighs
+these; a dead end state holds. the toggles
+of a lane are the popcount of its old and
+new codes. the outputs are left to the
+trace simulation
+********************************************/
+void simulate_lanes(sim_table_t *table, sim_report_t *report, sim_lanes_t *lanes, long long num_step)
+{
+  int l, s, t;
+  int num_input = table->num_input;
+  long long step;
+  long long state_toggles = report->state_toggles;
+  int *spec = table->spec;
+  int *spec_ptr = table->spec_ptr;
+  int *next_base = table->next_base;
+  uint64_t *next_code = table->next_code;
+  long long *hits = report->hits;
+  uint64_t x;
+
+  for(step = 0; step < num_step; step++) {
+    for(l = 0; l < SIM_LANES; l++) {
+      s = lanes->state[l];
+      // xorshift64*, scaled to the number of specified inputs
+      x = lanes->seed[l];
+      x ^= x >> 12;
+      x ^= x << 25;
+      x ^= x >> 27;
+      lanes->seed[l] = x;
+      t = spec_ptr[s + 1] - spec_ptr[s];
+      if(t == 0) {
+	hits[0]++;
+	continue;
+      }
+      t = spec[spec_ptr[s] + (int)((((x * 0x2545F4914F6CDD1DULL) >> 32) * (uint64_t)t) >> 32)];
+      hits[t]++;
+      state_toggles += POPCOUNT(lanes->code[l] ^ next_code[t]);
+      lanes->code[l] = next_code[t];
+      lanes->state[l] = next_base[t] >> num_input;
+    }
+  }
+
+  report->state_toggles = state_toggles;
+  report->num_cycle += num_step * SIM_LANES;
+}
@@ -0,0 +1,188 @@
+/*
+ * Streaming reader of input traces. The trace is
+ * read a buffer at a time and handed out as blocks
+ * of packed input vectors, so a trace of any length
+ * is simulated in constant memory. "-" reads the
+ * trace from the standard input.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "struct.h"
+#include "global.h"
+#include "context.h"
+#include "sim_struct.h"
+
+/*************** begin forward function proto declaration *************/
+trace_t *open_trace(char *file_name, int num_input, boolean binary);
+void close_trace(trace_t *trace);
+boolean fill_trace_buffer(trace_t *trace);
+int read_trace_block(trace_t *trace, uint32_t *input, int max_vector);
+/*************** end forward function proto declaration **************/
+
+trace_t *open_trace(char *file_name, int num_input, boolean binary)
+{
+  trace_t *trace = NULL;
+
+  if(num_input > SIM_MAX_INPUT) {
+    pow3_error(POW3_ERR_ARGUMENT, "ERROR: a trace of %d inputs is not supported, at most %d.\n", num_input, SIM_MAX_INPUT);
+    return NULL;
+  }
+
+  if((trace = (trace_t *)pow3_calloc(1, sizeof(trace_t))) == NULL)
+    return NULL;
+
+  trace->binary = binary;
+  trace->num_input = num_input;
+  trace->record_size = (num_input + 7) / 8 > 0 ? (num_input + 7) / 8 : 1;
+  if(!strcmp(file_name, "-"))
+    trace->fd = 0;
+  else if((trace->fd = open(file_name, O_RDONLY)) < 0) {
+    pow3_error(POW3_ERR_IO, "ERROR: Cannot open trace file %s\n", file_name);
+    pow3_free(trace);
+    return NULL;
+  }
+
+  if((trace->buffer = (char *)pow3_malloc(TRACE_BUFFER_SIZE)) == NULL) {
+    close_trace(trace);
+    return NULL;
+  }
+
+  return trace;
+}
+
+void close_trace(trace_t *trace)
+{
+  if(trace == NULL)
+    return;
+
+  if(trace->fd > 0)
+    close(trace->fd);
+  pow3_free(trace->buffer);
+  pow3_free(trace);
+}
+
+/**********************************
+keep the bytes not parsed yet and
+read behind them until the buffer
+is full or the trace ends
+**********************************/
+boolean fill_trace_buffer(trace_t *trace)
+{
+  ssize_t num_read;
+
+  if(trace->pos > 0) {
+    memmove(trace->buffer, trace->buffer + trace->pos, trace->length - trace->pos);
+    trace->length -= trace->pos;
+    trace->pos = 0;
+  }
+
+  while(trace->length < TRACE_BUFFER_SIZE && trace->eof == FALSE) {
+    num_read = read(trace->fd, trace->buffer + trace->length, TRACE_BUFFER_SIZE - trace->length);
+    if(num_read < 0) {
+      if(errno == EINTR)
+	continue;
+      pow3_error(POW3_ERR_IO, "ERROR: cannot read the trace.\n");
+      return FALSE;
+    }
+    if(num_read == 0)
+      trace->eof = TRUE;
+    trace->length += num_read;
+  }
+
+  return TRUE;
+}
+
+/**********************************
+up to max_vector input vectors of
+the trace, packed with input k in
+bit k. blank lines and text after
+'#' are skipped in a text trace.
+returns the number of vectors, 0
+at the end of the trace, UNDEFINE
+on an error
+**********************************/
+int read_trace_block(trace_t *trace, uint32_t *input, int max_vector)
+{
+  int k, b, count = 0;
+  char *p, *line_end;
+  uint32_t value;
+  unsigned char *record;
+
+  while(count < max_vector) {
+    if(trace->binary) {
+      if(trace->length - trace->pos < trace->record_size) {
+	if(trace->eof) {
+	  if(trace->length > trace->pos)
+	    pow3_log("Warning: %d bytes at the end of the trace are not a whole vector.\n", trace->length - trace->pos);
+	  trace->pos = trace->length;
+	  break;
+	}
+	if(fill_trace_buffer(trace) == FALSE)
+	  return UNDEFINE;
+	continue;
+      }
+
+      record = (unsigned char *)trace->buffer + trace->pos;
+      value = 0;
+      for(b = 0; b < trace->record_size && b < 4; b++)
+	value |= (uint32_t)record[b] << (8 * b);
+      if(trace->num_input < 32)
+	value &= ((uint32_t)1 << trace->num_input) - 1;
+      trace->pos += trace->record_size;
+      input[count++] = value;
+      continue;
+    }
+
+    p = trace->buffer + trace->pos;
+    line_end = (char *)memchr(p, '\n', trace->length - trace->pos);
+    if(line_end == NULL) {
+      if(trace->eof == FALSE) {
+	if(trace->pos == 0 && trace->length == TRACE_BUFFER_SIZE) {
+	  pow3_error(POW3_ERR_PARSE, "ERROR: line %lld of the trace is too long.\n", trace->line + 1);
+	  return UNDEFINE;
+	}
+	if(fill_trace_buffer(trace) == FALSE)
+	  return UNDEFINE;
+	continue;
+      }
+      // last line without a newline
+      if(trace->pos == trace->length)
+	break;
+      line_end = trace->buffer + trace->length;
+    }
+
+    trace->line++;
+    value = 0;
+    k = 0;
+    for(; p < line_end && *p != '#'; p++) {
+      if(*p == '0' || *p == '1') {
+	if(*p == '1' && k < trace->num_input)
+	  value |= (uint32_t)1 << k;
+	k++;
+      }
+      else if(*p != ' ' && *p != '\t' && *p != '\r') {
+	pow3_error(POW3_ERR_PARSE, "ERROR: Incorrect character '%c' in line %lld of the trace.\n", *p, trace->line);
+	return UNDEFINE;
+      }
+    }
+    trace->pos = line_end - trace->buffer + (line_end < trace->buffer + trace->length ? 1 : 0);
+
+    if(k == 0)
+      continue;
+    if(k != trace->num_input) {
+      pow3_error(POW3_ERR_PARSE, "ERROR: line %lld of the trace has %d inputs, %d expected.\n", trace->line, k, trace->num_input);
+      return UNDEFINE;
+    }
+    input[count++] = value;
+  }
+
+  trace->num_vector += count;
+
+  return count;
+}
@@ -0,0 +1,51 @@
+/*
+ *
+ * Convert a file of total transition probabilities
+ * between the .prob text table and the sparse binary
+ * format (.bprob). The format of the input is told
+ * by its first bytes; the output is binary unless
+ * -text is given.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include "struct.h"
+#include "global.h"
+#include "fsm.h"
+#include "matrix_util.h"
+
+extern csr_matrix_t *read_trans_prob(char *file_name, int n);
+extern boolean write_trans_prob(char *file_name, csr_matrix_t *trans_prob);
+extern void set_prob_format(int format);
+
+int main(int argc, char **argv)
+{
+  int arg = 1;
+  csr_matrix_t *trans_prob = NULL;
+
+  set_prob_format(PROB_BINARY);
+  if(argc > 1 && !strcmp(argv[1], "-text")) {
+    set_prob_format(PROB_TEXT);
+    arg++;
+  }
+  if(argc - arg != 2) {
+    printf("Usage: %s [-text] <input prob file> <output prob file>\n", argv[0]);
+    exit(1);
+  }
+
+  if((trans_prob = read_trans_prob(argv[arg], UNDEFINE)) == NULL)
+    exit(1);
+
+  if(write_trans_prob(argv[arg + 1], trans_prob) == FALSE) {
+    free_csr_matrix(trans_prob);
+    exit(1);
+  }
+
+  printf("%d states, %d transitions written to %s\n", trans_prob->num_row, trans_prob->num_nz, argv[arg + 1]);
+  free_csr_matrix(trans_prob);
+
+  return 0;
+}
@@ -7,33 +7,67 @@
 #include "fsm.h"
 
 extern boolean get_switching_activity(fsm_t *fsm, double *total_sw, boolean print_prob);
+extern void set_steady_state_method(int method);
+extern void set_prob_format(int format);
 
 int main(int argc, char **argv)
 {
   fsm_t *fsm;
   char *infile_name;
+  char *input_name = NULL;
+  char *prob_name = NULL;
   double switching = 0;
+  int i;
   
-  infile_name = argv[1];
+  // -dense selects the reference LU solver for the steady state,
+  // -input weights the transitions by the input probabilities in the file,
+  // -prob scores the codes on the transition probabilities of a file,
+  // -binary writes <fsm>.bprob instead of <fsm>.prob
+  for(i = 1; i < argc - 1; i++) {
+    if(!strcmp(argv[i], "-dense"))
+      set_steady_state_method(STEADY_DENSE);
+    else if(!strcmp(argv[i], "-binary"))
+      set_prob_format(PROB_BINARY);
+    else if(!strcmp(argv[i], "-input") && i < argc - 2)
+      input_name = argv[++i];
+    else if(!strcmp(argv[i], "-prob") && i < argc - 2)
+      prob_name = argv[++i];
+    else
+      break;
+  }
+  if(i != argc - 1) {
+    printf("Usage: %s [-dense] [-binary] [-input file | -prob file] <blif file>\n", argv[0]);
+    exit(1);
+  }
+  infile_name = argv[i];
   
-  init_fsm();  
-  fsm = get_fsm();
+  fsm = init_fsm();
 
-  if(read_fsm_from_blif(infile_name, fsm) == FALSE) {
+  if(read_fsm_from_blif_mmap(infile_name, fsm) == FALSE) {
     printf("ERROR: Unable to read FSM from the input blif file.\n");
-    free_fsm();
+    free_fsm(fsm);
+    exit(1);
+  }
+
+  if(input_name && read_input_prob(input_name, fsm) == FALSE) {
+    free_fsm(fsm);
     exit(1);
   }
+  set_fsm_prob_file(fsm, prob_name);
 
   print_fsm(fsm);
 
-  if(get_switching_activity(fsm, &switching, TRUE) == FALSE)
+  if(get_switching_activity(fsm, &switching, TRUE) == FALSE) {
+    free_fsm(fsm);
     exit(1);
+  }
 
   printf("\n");
   printf("-----------------------------------------------\n");
   printf("Total switching activity: %.2f\n", switching);
   printf("-----------------------------------------------\n");
 
+  free_fsm(fsm);
+
   return 0;
 }
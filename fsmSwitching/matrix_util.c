@@ -1,205 +1,195 @@
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include "struct.h"
 #include "global.h"
+#include "context.h"
+#include "matrix_util.h"
 
 /************** begin forward function prototype declaration ************/
-double **Transpose(double **a,int n, int m);
-double **Multiply(double **a, double **b, int n, int m, int l);
-void inverse(double**,int);
-void ludcmp(double**, int, int*, double*);
-void lubksb(double**, int, int*, double*);
+dense_matrix_t *alloc_dense_matrix(int n, int m);
+void free_dense_matrix(dense_matrix_t *a);
+void dense_transpose(dense_matrix_t *a, dense_matrix_t *b);
+int dense_ludcmp(dense_matrix_t *a, int *indx, double *d);
+void dense_lubksb(dense_matrix_t *a, int *indx, double *b);
+csr_matrix_t *alloc_csr_matrix(int n, int m, int nz);
+void free_csr_matrix(csr_matrix_t *a);
+csr_matrix_t *csr_transpose(csr_matrix_t *a);
+dense_matrix_t *csr_to_dense(csr_matrix_t *a);
+int write_csr_file(char *file_name, csr_matrix_t *a);
+int is_csr_image(char *image, size_t size);
+csr_matrix_t *read_csr_image(char *image, size_t size);
 /************** end function prototype declaration **********************/
 
 /************************************************
-   Transpose of a square matrix, do it in place
+   Allocate a zero n x m dense matrix. the rows
+   are padded to a multiple of DENSE_ALIGN bytes
+   and all of them sit in one aligned block
 *************************************************/
-double **Transpose(double **a,int n, int m)
+dense_matrix_t *alloc_dense_matrix(int n, int m)
 {
-   int i,j;
-   double **b;
-   b = (double **)malloc(m*sizeof(double *));
-   for (i=0;i<m;i++)
-     b[i] = (double *)malloc(n*sizeof(double));
-
-   for (i=0;i<n;i++)
-     for (j=0;j<m;j++)
-       b[j][i] = a[i][j];
-   return b;
-}
+  int align = DENSE_ALIGN / sizeof(double);
+  dense_matrix_t *a = (dense_matrix_t *)pow3_malloc(sizeof(dense_matrix_t));
 
-/*************************************************
-  Two matrix multiplication
-**************************************************/
-double **Multiply(double **a, double **b, int n, int m, int l)
-{
-  int i,j,k;
-  double **c;
-  c = (double **)malloc(n*sizeof(double *));
-  for (i=0;i<n;i++)
-    c[i] = (double *)malloc(m*sizeof(double));
-  for(i=0;i<n;i++)
-    for(j=0;j<m;j++)
-      c[i][j] = 0;
-  for (i=0;i<n;i++)
-    for (j=0; j < m; j++)
-      for (k=0; k < l; k++)
-	c[i][j] += a[i][k] * b[k][j];
-  return c;
+  if(a == NULL)
+    return NULL;
+
+  a->num_row = n;
+  a->num_col = m;
+  a->ld = (m + align - 1) / align * align;
+  if(a->ld == 0)
+    a->ld = align;
+  a->block = pow3_malloc((size_t)n * a->ld * sizeof(double) + DENSE_ALIGN);
+  if(a->block == NULL) {
+    pow3_free(a);
+    return NULL;
+  }
+  a->val = (double *)(((uintptr_t)a->block + DENSE_ALIGN - 1) & ~(uintptr_t)(DENSE_ALIGN - 1));
+  memset(a->val, 0, (size_t)n * a->ld * sizeof(double));
+
+  return a;
 }
 
-/*****************************************************
-  b= a - I and padd b's last one column by 1
-*****************************************************/
-double **Padding(double **a, int n)
+void free_dense_matrix(dense_matrix_t *a)
 {
-  int i,j;
-  double **b;
-  b = (double **)malloc(n*sizeof(double *));
-  for (i=0;i<n;i++)
-    b[i] = (double *)malloc((n+1)*sizeof(double));
-  for(i=0;i<n;i++)
-    for(j=0;j<n;j++)
-      {
-	if(i==j)
-	  b[i][j] = a[i][j] - 1;
-	else
-	  b[i][j] = a[i][j];
-      }
-  for(i=0;i<n;i++)
-    b[i][n]=1;
-  return b;
+  if(a == NULL)
+    return;
+  pow3_free(a->block);
+  pow3_free(a);
 }
 
-
-/**************************************************
-  Inversion of a matrix using Gaussian method
-***************************************************/
-void inverse(double **mat, int dim)
+/************************************************
+   Transpose of a n x m matrix into the m x n
+   matrix b, by tiles so that both sides stay
+   in cache
+*************************************************/
+void dense_transpose(dense_matrix_t *a, dense_matrix_t *b)
 {
- int i,j,*indx;
- double **y,d,*col;
-
- y = (double **)malloc(dim*sizeof(double *));
- for(i=0;i<dim;i++)
-   y[i]=(double *)malloc(dim*sizeof(double));
- 
- indx = (int *)malloc((unsigned)(dim*sizeof(int)));
- col = (double *)malloc((unsigned)(dim*sizeof(double)));
- ludcmp(mat,dim,indx,&d);
- for (j=0;j<dim;j++)
-    {
-     for (i=0;i<dim;i++) col[i] = 0.0;
-     col[j] = 1.0;
-     lubksb(mat,dim,indx,col);
-     for (i=0;i<dim;i++) y[i][j] = col[i];
+  int i, j, ii, jj, i_end, j_end;
+
+  for(ii = 0; ii < a->num_row; ii += DENSE_BLOCK) {
+    i_end = MIN(ii + DENSE_BLOCK, a->num_row);
+    for(jj = 0; jj < a->num_col; jj += DENSE_BLOCK) {
+      j_end = MIN(jj + DENSE_BLOCK, a->num_col);
+      for(i = ii; i < i_end; i++)
+	for(j = jj; j < j_end; j++)
+	  DENSE_ELEM(b, j, i) = DENSE_ELEM(a, i, j);
     }
- for (i=0;i<dim;i++)
-    for (j=0;j<dim;j++)
-       mat[i][j] = y[i][j];
- 
- for(i=0;i<dim;i++)
-   free(y[i]);
- free(col);
- free(indx);
+  }
 }
 
 /********************************************
-LU decomposition
+LU decomposition in place with scaled partial
+pivoting, FALSE if the matrix is singular.
+the rows are swapped whole and each pivot
+updates the rows below it along contiguous
+memory
 ********************************************/
-void ludcmp(double **a, int n, int *indx, double *d)
+int dense_ludcmp(dense_matrix_t *a, int *indx, double *d)
 {
-  int i,imax,j,k;
-  double   big,dum,sum,temp;
-  double   *vv;
+  int i, imax, j, k, n = a->num_row;
+  double big, dum, temp;
+  double *vv;
+  double *restrict row_i;
+  const double *restrict row_j;
 
-  vv = (double*)malloc((unsigned)(n*sizeof(double)));
-  if (!vv) {
-    fprintf(stderr,"Error Allocating Vector Memory\n");
-    exit(1);
-  }
+  vv = (double *)pow3_malloc((n + 1) * sizeof(double));
+  if(vv == NULL)
+    return FALSE;
   *d = 1.0;
-  for (i=0;i<n;i++) {
+  for(i = 0; i < n; i++) {
     big = 0.0;
-    for (j=0;j<n;j++) {
-      if ((temp=fabs(a[i][j])) > big) big = temp;
-    }
-    if (big == 0.0) {
-      fprintf(stderr,"Singular Matrix in Routine LUDCMP\n");
-      for (j=0;j<n;j++) printf(" %f ",a[i][j]); printf("/n");
-      exit(1);
+    row_i = &DENSE_ELEM(a, i, 0);
+    for(j = 0; j < n; j++)
+      if((temp = fabs(row_i[j])) > big)
+	big = temp;
+    if(big == 0.0) {
+      pow3_error(POW3_ERR_SINGULAR, "ERROR: Singular Matrix in Routine LUDCMP\n");
+      pow3_free(vv);
+      return FALSE;
     }
-    vv[i] = 1.0/big;
+    vv[i] = 1.0 / big;
   }
-  for (j=0;j<n;j++) {
-    for (i=0;i<j;i++) {
-      sum = a[i][j];
-      for (k=0;k<i;k++) sum -= a[i][k] * a[k][j];
-      a[i][j] = sum;
-    }
+
+  for(j = 0; j < n; j++) {
     big = 0.0;
-    for (i=j;i<n;i++) {
-      sum = a[i][j];
-      for (k=0;k<j;k++) sum -= a[i][k] * a[k][j];
-      a[i][j] = sum;
-      if ((dum=vv[i]*fabs(sum)) >= big) {
+    imax = j;
+    for(i = j; i < n; i++) {
+      if((dum = vv[i] * fabs(DENSE_ELEM(a, i, j))) >= big) {
 	big = dum;
 	imax = i;
       }
     }
-    if (j != imax) {
-      for (k=0;k<n;k++) {
-	dum = a[imax][k];
-	a[imax][k] = a[j][k];
-	a[j][k] = dum;
+    if(j != imax) {
+      row_i = &DENSE_ELEM(a, imax, 0);
+      for(k = 0; k < n; k++) {
+	dum = row_i[k];
+	row_i[k] = DENSE_ELEM(a, j, k);
+	DENSE_ELEM(a, j, k) = dum;
       }
       *d = -(*d);
       vv[imax] = vv[j];
     }
     indx[j] = imax;
-    if (a[j][j] == 0.0) a[j][j] = TINY;
-    if (j != n-1) {
-      dum = 1.0 / a[j][j];
-      for (i=j+1;i<n;i++) a[i][j] *= dum;
+    if(DENSE_ELEM(a, j, j) == 0.0)
+      DENSE_ELEM(a, j, j) = TINY;
+
+    row_j = &DENSE_ELEM(a, j, 0);
+    dum = 1.0 / row_j[j];
+    for(i = j + 1; i < n; i++) {
+      row_i = &DENSE_ELEM(a, i, 0);
+      if(row_i[j] == 0)
+	continue;
+      temp = (row_i[j] *= dum);
+      for(k = j + 1; k < n; k++)
+	row_i[k] -= temp * row_j[k];
     }
   }
-  free(vv);
+  pow3_free(vv);
+  return TRUE;
 }
 
 /************************************************
 LU back substitute
 *************************************************/
-void lubksb(double **a, int n, int *indx, double *b)
+void dense_lubksb(dense_matrix_t *a, int *indx, double *b)
 {
-  int i,ip,j,ii=-1;
-  double   sum;
+  int i, ip, j, ii = -1, n = a->num_row;
+  double sum;
+  double *row;
 
-  for (i=0;i<n;i++) {
+  for(i = 0; i < n; i++) {
     ip = indx[i];
     sum = b[ip];
     b[ip] = b[i];
-    if (ii>=0)
-      for (j=ii;j<i;j++) sum -= a[i][j] * b[j];
-    else if (sum) ii = i;
+    row = &DENSE_ELEM(a, i, 0);
+    if(ii >= 0)
+      for(j = ii; j < i; j++)
+	sum -= row[j] * b[j];
+    else if(sum)
+      ii = i;
     b[i] = sum;
   }
-  for (i=n-1;i>=0;i--) {
+  for(i = n - 1; i >= 0; i--) {
     sum = b[i];
-    for (j=i+1;j<n;j++) sum -= a[i][j] * b[j];
-    b[i] = sum / a[i][i];
+    row = &DENSE_ELEM(a, i, 0);
+    for(j = i + 1; j < n; j++)
+      sum -= row[j] * b[j];
+    b[i] = sum / row[i];
   }
 }
 
 /************************************
-Print out a double matrix
+Print out a dense matrix
 *************************************/
-void print_matrix(double **array, int n, int m)
+void print_matrix(dense_matrix_t *a)
 {
   int i, j;
   
-  for(i = 0; i < n; i++) {
-    for(j = 0;  j < m; j++)
-      printf("%.2f ", array[i][j]);
+  for(i = 0; i < a->num_row; i++) {
+    for(j = 0;  j < a->num_col; j++)
+      printf("%.2f ", DENSE_ELEM(a, i, j));
     printf("\n");
   }
 }
@@ -215,3 +205,216 @@ void print_vector(double *array, int n)
     printf("%.2f ", array[i]);
   printf("\n");
 }
+
+/************************************
+Allocate an n x m sparse matrix with
+room for nz nonzero entries, NULL if
+out of memory
+*************************************/
+csr_matrix_t *alloc_csr_matrix(int n, int m, int nz)
+{
+  csr_matrix_t *a = (csr_matrix_t *)pow3_malloc(sizeof(csr_matrix_t));
+
+  if(a == NULL)
+    return NULL;
+
+  a->num_row = n;
+  a->num_col = m;
+  a->num_nz = nz;
+  a->row_ptr = (int *)pow3_calloc(n + 1, sizeof(int));
+  a->col_idx = (int *)pow3_calloc(nz > 0 ? nz : 1, sizeof(int));
+  a->val = (double *)pow3_calloc(nz > 0 ? nz : 1, sizeof(double));
+  if(a->row_ptr == NULL || a->col_idx == NULL || a->val == NULL) {
+    free_csr_matrix(a);
+    return NULL;
+  }
+
+  return a;
+}
+
+void free_csr_matrix(csr_matrix_t *a)
+{
+  if(a == NULL)
+    return;
+  pow3_free(a->row_ptr);
+  pow3_free(a->col_idx);
+  pow3_free(a->val);
+  pow3_free(a);
+}
+
+/************************************
+Transpose of a sparse matrix, the
+column indices in each row of the 
+result stay sorted. NULL if out of
+memory
+*************************************/
+csr_matrix_t *csr_transpose(csr_matrix_t *a)
+{
+  int i, k, pos;
+  int *next;
+  csr_matrix_t *b = alloc_csr_matrix(a->num_col, a->num_row, a->num_nz);
+
+  if(b == NULL)
+    return NULL;
+
+  for(k = 0; k < a->num_nz; k++)
+    b->row_ptr[a->col_idx[k] + 1]++;
+  for(i = 0; i < b->num_row; i++)
+    b->row_ptr[i + 1] += b->row_ptr[i];
+
+  if((next = (int *)pow3_malloc((b->num_row + 1) * sizeof(int))) == NULL) {
+    free_csr_matrix(b);
+    return NULL;
+  }
+  for(i = 0; i <= b->num_row; i++)
+    next[i] = b->row_ptr[i];
+
+  for(i = 0; i < a->num_row; i++) {
+    for(k = a->row_ptr[i]; k < a->row_ptr[i + 1]; k++) {
+      pos = next[a->col_idx[k]]++;
+      b->col_idx[pos] = i;
+      b->val[pos] = a->val[k];
+    }
+  }
+
+  pow3_free(next);
+  return b;
+}
+
+/************************************
+Dense copy of a sparse matrix
+*************************************/
+dense_matrix_t *csr_to_dense(csr_matrix_t *a)
+{
+  int i, k;
+  dense_matrix_t *b = alloc_dense_matrix(a->num_row, a->num_col);
+
+  if(b == NULL)
+    return NULL;
+
+  for(i = 0; i < a->num_row; i++)
+    for(k = a->row_ptr[i]; k < a->row_ptr[i + 1]; k++)
+      DENSE_ELEM(b, i, a->col_idx[k]) += a->val[k];
+
+  return b;
+}
+
+/************************************
+write a sparse matrix file, see
+csr_file_header_t
+*************************************/
+int write_csr_file(char *file_name, csr_matrix_t *a)
+{
+  csr_file_header_t header;
+  size_t row_bytes = CSR_FILE_ALIGN((size_t)(a->num_row + 1) * sizeof(int32_t));
+  size_t pad;
+  char zero[8] = {0};
+  int ok;
+  FILE *ofp = NULL;
+
+  if((ofp = fopen(file_name, "wb")) == NULL) {
+    pow3_error(POW3_ERR_IO, "ERROR: cannot open output matrix file %s\n", file_name);
+    return FALSE;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CSR_FILE_MAGIC, sizeof(header.magic));
+  header.version = CSR_FILE_VERSION;
+  header.byte_order = CSR_BYTE_ORDER;
+  header.header_size = CSR_FILE_ALIGN(sizeof(header));
+  header.num_row = a->num_row;
+  header.num_col = a->num_col;
+  header.num_nz = a->row_ptr[a->num_row];
+
+  pad = row_bytes - (a->num_row + 1) * sizeof(int32_t);
+  ok = fwrite(&header, sizeof(header), 1, ofp) == 1
+    && fwrite(zero, 1, header.header_size - sizeof(header), ofp) == header.header_size - sizeof(header)
+    && fwrite(a->val, sizeof(double), header.num_nz, ofp) == (size_t)header.num_nz
+    && fwrite(a->row_ptr, sizeof(int32_t), a->num_row + 1, ofp) == (size_t)(a->num_row + 1)
+    && fwrite(zero, 1, pad, ofp) == pad
+    && fwrite(a->col_idx, sizeof(int32_t), header.num_nz, ofp) == (size_t)header.num_nz;
+
+  if(fclose(ofp) != 0 || !ok) {
+    pow3_error(POW3_ERR_IO, "ERROR: cannot write matrix file %s\n", file_name);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/************************************
+TRUE if the bytes are a sparse matrix
+file
+*************************************/
+int is_csr_image(char *image, size_t size)
+{
+  return size >= sizeof(csr_file_header_t) && !memcmp(image, CSR_FILE_MAGIC, sizeof(CSR_FILE_MAGIC));
+}
+
+/************************************
+a copy of the sparse matrix of a file
+image, mapped or read in. the sizes,
+the row pointers and the columns are
+checked against the image
+*************************************/
+csr_matrix_t *read_csr_image(char *image, size_t size)
+{
+  int i, k;
+  csr_file_header_t header;
+  size_t val_pos, row_pos, col_pos;
+  int32_t *row_ptr, *col_idx;
+  csr_matrix_t *a = NULL;
+
+  if(is_csr_image(image, size) == FALSE) {
+    pow3_error(POW3_ERR_PARSE, "ERROR: not a sparse matrix file.\n");
+    return NULL;
+  }
+  memcpy(&header, image, sizeof(header));
+  if(header.byte_order != CSR_BYTE_ORDER) {
+    pow3_error(POW3_ERR_PARSE, "ERROR: the sparse matrix file was written in another byte order.\n");
+    return NULL;
+  }
+  if(header.version > CSR_FILE_VERSION || header.version < 1) {
+    pow3_error(POW3_ERR_PARSE, "ERROR: sparse matrix file version %u, only %d and older are supported.\n", header.version, CSR_FILE_VERSION);
+    return NULL;
+  }
+  if(header.num_row < 0 || header.num_col < 0 || header.num_nz < 0 || header.header_size < sizeof(header) || header.header_size % 8 != 0) {
+    pow3_error(POW3_ERR_PARSE, "ERROR: incorrect sparse matrix file header.\n");
+    return NULL;
+  }
+
+  val_pos = header.header_size;
+  row_pos = val_pos + (size_t)header.num_nz * sizeof(double);
+  col_pos = row_pos + CSR_FILE_ALIGN((size_t)(header.num_row + 1) * sizeof(int32_t));
+  if(col_pos + (size_t)header.num_nz * sizeof(int32_t) > size) {
+    pow3_error(POW3_ERR_PARSE, "ERROR: the sparse matrix file is cut short, %lu of %lu bytes.\n", (unsigned long)size, (unsigned long)(col_pos + (size_t)header.num_nz * sizeof(int32_t)));
+    return NULL;
+  }
+
+  row_ptr = (int32_t *)(image + row_pos);
+  col_idx = (int32_t *)(image + col_pos);
+  for(i = 0; i < header.num_row; i++) {
+    if(row_ptr[i] > row_ptr[i + 1]) {
+      pow3_error(POW3_ERR_PARSE, "ERROR: row %d of the sparse matrix file has a negative length.\n", i);
+      return NULL;
+    }
+  }
+  if(row_ptr[0] != 0 || row_ptr[header.num_row] != header.num_nz) {
+    pow3_error(POW3_ERR_PARSE, "ERROR: the rows of the sparse matrix file do not hold its %d entries.\n", header.num_nz);
+    return NULL;
+  }
+  for(k = 0; k < header.num_nz; k++) {
+    if(col_idx[k] < 0 || col_idx[k] >= header.num_col) {
+      pow3_error(POW3_ERR_PARSE, "ERROR: entry %d of the sparse matrix file is in column %d of %d.\n", k, col_idx[k], header.num_col);
+      return NULL;
+    }
+  }
+
+  if((a = alloc_csr_matrix(header.num_row, header.num_col, header.num_nz)) == NULL)
+    return NULL;
+  memcpy(a->val, image + val_pos, (size_t)header.num_nz * sizeof(double));
+  memcpy(a->row_ptr, row_ptr, (size_t)(header.num_row + 1) * sizeof(int32_t));
+  memcpy(a->col_idx, col_idx, (size_t)header.num_nz * sizeof(int32_t));
+
+  return a;
+}
@@ -1,8 +1,82 @@
-extern double **Transpose(double **a,int n, int m);
-extern double **Multiply(double **a, double **b, int n, int m, int l);
-extern double **Padding(double **a, int n);
-extern void inverse(double**,int);
-extern void ludcmp(double**, int, int*, double*);
-extern void lubksb(double**, int, int*, double*);
-extern void print_matrix(double **array, int n, int m);
+#ifndef MATRIX_UTIL_H
+#define MATRIX_UTIL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define DENSE_ALIGN   64  // bytes, alignment of the rows of a dense matrix
+#define DENSE_BLOCK   64  // rows/columns per tile of the blocked routines
+
+#ifndef MIN
+#define MIN(a, b)     ((a) < (b) ? (a) : (b))
+#endif
+
+/**********************************
+dense row-major matrix in a single
+aligned block, element (i, j) is
+val[i * ld + j]
+**********************************/
+typedef struct dense_matrix_struct {
+  int num_row;
+  int num_col;
+  int ld;         // leading dimension, doubles from one row to the next
+  double *val;
+  void *block;    // allocation holding val
+} dense_matrix_t;
+
+#define DENSE_ELEM(a, i, j)  ((a)->val[(size_t)(i) * (a)->ld + (j)])
+
+/**********************************
+compressed sparse row matrix, row i
+holds col_idx/val[row_ptr[i]..row_ptr[i+1])
+**********************************/
+typedef struct csr_matrix_struct {
+  int num_row;
+  int num_col;
+  int num_nz;
+  int *row_ptr;
+  int *col_idx;
+  double *val;
+} csr_matrix_t;
+
+#define CSR_FILE_MAGIC      "POW3CSR"   // 8 bytes with the '\0'
+#define CSR_FILE_VERSION    1
+#define CSR_BYTE_ORDER      0x01020304
+
+/**********************************
+header of a sparse matrix file. it
+is followed by val[num_nz], row_ptr
+[num_row + 1] and col_idx[num_nz],
+each at a multiple of 8 bytes, all
+in the byte order of the machine
+that wrote it, so that the file can
+be mapped and used as it is
+**********************************/
+typedef struct csr_file_header_struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;    // CSR_BYTE_ORDER as written
+  uint32_t header_size;   // bytes before val
+  int32_t num_row;
+  int32_t num_col;
+  int32_t num_nz;
+} csr_file_header_t;
+
+#define CSR_FILE_ALIGN(n)   (((n) + 7) / 8 * 8)
+
+extern dense_matrix_t *alloc_dense_matrix(int n, int m);
+extern void free_dense_matrix(dense_matrix_t *a);
+extern void dense_transpose(dense_matrix_t *a, dense_matrix_t *b);
+extern int dense_ludcmp(dense_matrix_t *a, int *indx, double *d);
+extern void dense_lubksb(dense_matrix_t *a, int *indx, double *b);
+extern void print_matrix(dense_matrix_t *a);
 extern void print_vector(double *array, int n);
+extern csr_matrix_t *alloc_csr_matrix(int n, int m, int nz);
+extern void free_csr_matrix(csr_matrix_t *a);
+extern csr_matrix_t *csr_transpose(csr_matrix_t *a);
+extern dense_matrix_t *csr_to_dense(csr_matrix_t *a);
+extern int write_csr_file(char *file_name, csr_matrix_t *a);
+extern int is_csr_image(char *image, size_t size);
+extern csr_matrix_t *read_csr_image(char *image, size_t size);
+
+#endif
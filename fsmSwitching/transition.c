@@ -2,184 +2,783 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "struct.h"
 #include "global.h"
+#include "context.h"
 #include "fsm.h"
 #include "matrix_util.h"
 
+/*************** begin forward function proto declaration *************/
+boolean write_trans_prob(char *file_name, csr_matrix_t *trans_prob);
+csr_matrix_t *read_trans_prob(char *file_name, int n);
+/*************** end forward function proto declaration **************/
+
+/**********************************************
+calculate the steady state probability, 
+based on Markov chain model. pi P = pi is
+solved directly as (P^T - I) pi = 0 with
+the last balance equation replaced by
+sum(pi) = 1, one LU factorization and one
+substitution. the residual of pi P = pi is
+reported, and checked against STEADY_RESIDUAL
+***********************************************/
+double *get_steady_state_prob(dense_matrix_t *conditional)
+{
+  int i, j, n = conditional->num_row;
+  int *indx = NULL;
+  double d, residual, total;
+  double *steady_prob = NULL;
+  double *balance = NULL;
+  double *row;
+  dense_matrix_t *a = NULL;
+
+  indx = (int *)pow3_malloc((n + 1) * sizeof(int));
+  steady_prob = (double *)pow3_calloc(n, sizeof(double));
+  balance = (double *)pow3_calloc(n, sizeof(double));
+  a = alloc_dense_matrix(n, n);
+  if(indx == NULL || steady_prob == NULL || balance == NULL || a == NULL || n == 0)
+    goto failure;
+
+  dense_transpose(conditional, a);
+  for(i = 0; i < n; i++)
+    DENSE_ELEM(a, i, i) -= 1;
+  for(j = 0; j < n; j++)
+    DENSE_ELEM(a, n - 1, j) = 1;
+
+  // a singular system has no unique steady state
+  if(dense_ludcmp(a, indx, &d) == FALSE)
+    goto failure;
+  steady_prob[n - 1] = 1;
+  dense_lubksb(a, indx, steady_prob);
+
+  // balance = pi P - pi, along the rows of P
+  total = 0;
+  for(i = 0; i < n; i++) {
+    balance[i] -= steady_prob[i];
+    total += steady_prob[i];
+    row = &DENSE_ELEM(conditional, i, 0);
+    for(j = 0; j < n; j++)
+      balance[j] += steady_prob[i] * row[j];
+  }
+  residual = fabs(total - 1);
+  for(j = 0; j < n; j++)
+    if(fabs(balance[j]) > residual)
+      residual = fabs(balance[j]);
+
+  pow3_log("Steady state residual: %.3e\n", residual);
+  if(residual > STEADY_RESIDUAL)
+    pow3_log("Warning: steady state residual %.3e exceeds %.1e, the probabilities may be inaccurate.\n", residual, STEADY_RESIDUAL);
+
+  pow3_free(indx);
+  pow3_free(balance);
+  free_dense_matrix(a);
+
+  return steady_prob;
+
+ failure:
+  pow3_free(indx);
+  pow3_free(steady_prob);
+  pow3_free(balance);
+  free_dense_matrix(a);
+
+  return NULL;
+}
+
 /*****************************************
 calculate the conditional probability
-array in FSM
+matrix in FSM in sparse form, straight
+from the transition list. a transition
+is weighted by the probability of its
+input cube, the number of input vectors
+in it by default. parallel transitions
+between the same pair of states are
+merged into one entry. NULL if out of
+memory
 ******************************************/
-double **get_cond_trans_prob(fsm_t *fsm)
+csr_matrix_t *get_cond_trans_csr(fsm_t *fsm)
 {
-  int i, j;
+  int i, j, k, pos;
+  int n = fsm->num_state;
   int dontcare = 0;
-  double num_trans = 0;
   int cstate = 0, nstate = 0;
-  double row_sum = 0, col_sum = 0;
-  char *input_string = NULL;
-  double **prob_array = (double **)calloc(fsm->num_state, sizeof(double *));
+  double row_sum = 0;
+  int *next = NULL;
+  int *last = NULL;
+  boolean *reached = NULL;
+  csr_matrix_t *prob = alloc_csr_matrix(n, n, fsm->num_transition);
 
-  for(i = 0; i < fsm->num_state; i++) {
-    prob_array[i] = (double *)calloc(fsm->num_state, sizeof(double));
-    for(j = 0; j < fsm->num_state; j++)
-      prob_array[i][j] = 0;
+  next = (int *)pow3_malloc((n + 1) * sizeof(int));
+  last = (int *)pow3_malloc((n + 1) * sizeof(int));
+  reached = (boolean *)pow3_calloc(n + 1, sizeof(boolean));
+  if(prob == NULL || next == NULL || last == NULL || reached == NULL) {
+    free_csr_matrix(prob);
+    prob = NULL;
+    goto done;
   }
 
+  for(i = 0; i < fsm->num_transition; i++)
+    prob->row_ptr[fsm->transition[i].current_state->index + 1]++;
+  for(i = 0; i < n; i++)
+    prob->row_ptr[i + 1] += prob->row_ptr[i];
+
+  for(i = 0; i <= n; i++)
+    next[i] = prob->row_ptr[i];
+
   for(i = 0; i < fsm->num_transition; i++) {
-    dontcare = 0;
-    input_string = fsm->transition[i].input;
     cstate = fsm->transition[i].current_state->index;
     nstate = fsm->transition[i].next_state->index;
-
-    for(j = 0; j < fsm->num_input; j++) {
-      if(input_string[j] == '-')
-	dontcare++;
-    }    
-    num_trans = (double)pow(2, dontcare);
-    prob_array[cstate][nstate] += num_trans;
+    pos = next[cstate]++;
+    prob->col_idx[pos] = nstate;
+    // every input vector equally likely unless the FSM has input probabilities
+    if(fsm->input_prob)
+      prob->val[pos] = cube_prob(&fsm->transition[i].in_cube, fsm->input_prob, fsm->num_input);
+    else {
+      dontcare = cube_num_dontcare(&fsm->transition[i].in_cube, fsm->num_input);
+      prob->val[pos] = (double)pow(2, dontcare);
+    }
   }
 
-  for(i = 0; i < fsm->num_state; i++) {
-    col_sum = 0;
-    for(j = 0; j < fsm->num_state; j++)
-      col_sum = col_sum + prob_array[j][i];
+  // merge parallel transitions and compact the rows in place
+  for(j = 0; j < n; j++)
+    last[j] = UNDEFINE;
 
-    if(col_sum == 0) {
-      printf("Warning: state %s is an unreachable state!\n", fsm->state[i].name);
-      goto failure;
+  pos = 0;
+  for(i = 0; i < n; i++) {
+    k = prob->row_ptr[i];
+    prob->row_ptr[i] = pos;
+    for(; k < next[i]; k++) {
+      // a transition the inputs never take is no edge
+      if(prob->val[k] == 0)
+	continue;
+      nstate = prob->col_idx[k];
+      if(last[nstate] >= prob->row_ptr[i]) {
+	prob->val[last[nstate]] += prob->val[k];
+      }
+      else {
+	last[nstate] = pos;
+	prob->col_idx[pos] = nstate;
+	prob->val[pos] = prob->val[k];
+	pos++;
+      }
+      reached[nstate] = TRUE;
     }
   }
+  prob->row_ptr[n] = pos;
+  prob->num_nz = pos;
 
-  for(i = 0; i < fsm->num_state; i++) {
+  // unreachable and dead end states are left to the class
+  // decomposition of solve_steady_state
+  for(i = 0; i < n; i++) {
+    if(reached[i] == FALSE)
+      pow3_log("Warning: state %s is an unreachable state, its probability is 0.\n", fsm->state[i].name);
+  }
+
+  for(i = 0; i < n; i++) {
     row_sum = 0;
-    for(j = 0; j < fsm->num_state; j++)
-      row_sum = row_sum + prob_array[i][j];
+    for(k = prob->row_ptr[i]; k < prob->row_ptr[i + 1]; k++)
+      row_sum = row_sum + prob->val[k];
 
-    if(row_sum==0) {
-      printf("Warning: state %s has no next state!\n",fsm->state[i].name);
-      goto failure;
+    if(row_sum == 0) {
+      pow3_log("Warning: state %s has no next state, it is taken as absorbing.\n", fsm->state[i].name);
+      continue;
     }
 
-    for(j = 0; j < fsm->num_state; j++) {
-      prob_array[i][j] = prob_array[i][j]/row_sum;
-    }
+    for(k = prob->row_ptr[i]; k < prob->row_ptr[i + 1]; k++)
+      prob->val[k] = prob->val[k]/row_sum;
   }
 
-  return prob_array;
+ done:
+  pow3_free(next);
+  pow3_free(last);
+  pow3_free(reached);
+  return prob;
+}
 
- failure: 
-  for(i = 0; i < fsm->num_state; i++)
-    free(prob_array[i]);
-  free(prob_array);
+/******************************************
+the neighbors of every state: the states
+it has a transition to or from, each one
+listed once in order of its first
+transition, self loops left out. the
+neighbors of state i are adj_state[
+adj_ptr[i]..adj_ptr[i+1]), and adj_count,
+if asked for, has the number of
+transitions i->j and j->i of each. the
+arrays are freed with pow3_free
+******************************************/
+boolean get_state_adjacency(fsm_t *fsm, int **adj_ptr, int **adj_state, int **adj_count)
+{
+  int i, j, k;
+  int cs_id, ns_id;
+  int n = fsm->num_state;
+  int *edge_ptr = NULL;
+  int *edge_state = NULL;
+  int *fill = NULL;
+  int *pos = NULL;
+  int *count = NULL;
+  boolean ret_flag = FALSE;
 
-  return NULL;
+  *adj_ptr = NULL;
+  *adj_state = NULL;
+  if(adj_count)
+    *adj_count = NULL;
+
+  // bucket both ends of every transition by state
+  if((edge_ptr = (int *)pow3_calloc(n + 1, sizeof(int))) == NULL)
+    goto failure;
+  for(i = 0; i < fsm->num_transition; i++) {
+    cs_id = (fsm->transition[i].current_state)->index;
+    ns_id = (fsm->transition[i].next_state)->index;
+    if(cs_id == ns_id)
+      continue;
+    edge_ptr[cs_id + 1]++;
+    edge_ptr[ns_id + 1]++;
+  }
+  for(i = 0; i < n; i++)
+    edge_ptr[i + 1] += edge_ptr[i];
+
+  edge_state = (int *)pow3_malloc((edge_ptr[n] + 1) * sizeof(int));
+  fill = (int *)pow3_malloc((n + 1) * sizeof(int));
+  pos = (int *)pow3_malloc((n + 1) * sizeof(int));
+  count = (int *)pow3_calloc(edge_ptr[n] + 1, sizeof(int));
+  *adj_ptr = (int *)pow3_malloc((n + 1) * sizeof(int));
+  *adj_state = (int *)pow3_malloc((edge_ptr[n] + 1) * sizeof(int));
+  if(edge_state == NULL || fill == NULL || pos == NULL || count == NULL || *adj_ptr == NULL || *adj_state == NULL)
+    goto failure;
+
+  memcpy(fill, edge_ptr, (n + 1) * sizeof(int));
+  for(i = 0; i < fsm->num_transition; i++) {
+    cs_id = (fsm->transition[i].current_state)->index;
+    ns_id = (fsm->transition[i].next_state)->index;
+    if(cs_id == ns_id)
+      continue;
+    edge_state[fill[cs_id]++] = ns_id;
+    edge_state[fill[ns_id]++] = cs_id;
+  }
+
+  // merge the parallel transitions into one neighbor
+  for(i = 0; i < n; i++)
+    pos[i] = UNDEFINE;
+  (*adj_ptr)[0] = 0;
+  for(i = 0; i < n; i++) {
+    (*adj_ptr)[i + 1] = (*adj_ptr)[i];
+    for(k = edge_ptr[i]; k < edge_ptr[i + 1]; k++) {
+      j = edge_state[k];
+      if(pos[j] == UNDEFINE) {
+	pos[j] = (*adj_ptr)[i + 1]++;
+	(*adj_state)[pos[j]] = j;
+      }
+      count[pos[j]]++;
+    }
+    for(k = (*adj_ptr)[i]; k < (*adj_ptr)[i + 1]; k++)
+      pos[(*adj_state)[k]] = UNDEFINE;
+  }
+
+  if(adj_count) {
+    *adj_count = count;
+    count = NULL;
+  }
+  ret_flag = TRUE;
+
+ failure:
+  if(ret_flag == FALSE) {
+    pow3_error(POW3_ERR_MEMORY, "ERROR: cannot allocate the state adjacency.\n");
+    pow3_free(*adj_ptr);
+    pow3_free(*adj_state);
+    *adj_ptr = NULL;
+    *adj_state = NULL;
+  }
+  pow3_free(edge_ptr);
+  pow3_free(edge_state);
+  pow3_free(fill);
+  pow3_free(pos);
+  pow3_free(count);
+  return ret_flag;
 }
 
 /**********************************************
-calculate the steady state probability, 
-based on Markov chain model
+calculate the steady state probability with
+Gauss-Seidel sweeps over the sparse conditional
+probability matrix. each sweep solves 
+pi[j] = sum_i pi[i] * P[i][j] in place and 
+renormalizes, until the largest change drops
+below the tolerance or the iteration cap is hit.
+NULL if out of memory
 ***********************************************/
-double *get_steady_state_prob(double **conditional, int n)
-{
-  int i,j;
-  double *tmp_vec = (double *)calloc(n, sizeof(double));
-  double *tmp_vec_plus =  (double *)calloc(n+1, sizeof(double));
-  double **tmp_arr = (double **)calloc(n, sizeof(double *));
-  double **b = (double **)calloc(n, sizeof(double *));
-  double **bt = (double **)calloc(n+1, sizeof(double *));
-  double *steady_prob = (double *)calloc(n, sizeof(double));
- 
-  for(i = 0; i < n; i++) {
-    tmp_arr[i]=(double *)calloc(n, sizeof(double));
-    b[i] = (double *)calloc(n+1, sizeof(double));
-    for(j = 0; j < n+1; j++)
-      b[i][j] = 0;
+double *get_steady_state_prob_sparse(csr_matrix_t *conditional, int n)
+{
+  int i, j, k, iter;
+  double sum, diag, total, diff;
+  csr_matrix_t *incoming = csr_transpose(conditional);
+  double *steady_prob = (double *)pow3_calloc(n + 1, sizeof(double));
+  double *prev_prob = (double *)pow3_calloc(n + 1, sizeof(double));
+
+  if(incoming == NULL || steady_prob == NULL || prev_prob == NULL) {
+    pow3_free(steady_prob);
+    steady_prob = NULL;
+    goto done;
   }
 
-  for(i = 0; i < n+1; i++) {
-    bt[i]=(double *)calloc(n, sizeof(double));
+  for(i = 0; i < n; i++)
+    steady_prob[i] = 1.0 / n;
+
+  for(iter = 0; iter < STEADY_MAX_ITER; iter++) {
+    memcpy(prev_prob, steady_prob, n * sizeof(double));
+
+    for(j = 0; j < n; j++) {
+      sum = 0;
+      diag = 0;
+      for(k = incoming->row_ptr[j]; k < incoming->row_ptr[j + 1]; k++) {
+	i = incoming->col_idx[k];
+	if(i == j)
+	  diag = incoming->val[k];
+	else
+	  sum += steady_prob[i] * incoming->val[k];
+      }
+      // an absorbing state keeps its current mass
+      if(1 - diag > TINY)
+	steady_prob[j] = sum / (1 - diag);
+    }
+
+    total = 0;
     for(j = 0; j < n; j++)
-      bt[i][j] = 0;
+      total += steady_prob[j];
+    if(total <= 0)
+      break;
+
+    diff = 0;
+    for(j = 0; j < n; j++) {
+      steady_prob[j] /= total;
+      if(fabs(steady_prob[j] - prev_prob[j]) > diff)
+	diff = fabs(steady_prob[j] - prev_prob[j]);
+    }
+
+    if(diff < STEADY_TOLERANCE)
+      break;
+  }
+
+  if(iter == STEADY_MAX_ITER)
+    pow3_log("Warning: steady state probability did not converge after %d iterations.\n", iter);
+
+ done:
+  pow3_free(prev_prob);
+  free_csr_matrix(incoming);
+
+  return steady_prob;
+}
+
+/**********************************************
+select the steady state solver used by
+get_trans_prob(_csr), STEADY_SPARSE by default or
+STEADY_DENSE for the direct LU solve
+***********************************************/
+void set_steady_state_method(int method)
+{
+  get_context()->steady_method = method;
+}
+
+/**********************************************
+select the format of the probability files
+written, PROB_TEXT by default or PROB_BINARY
+***********************************************/
+void set_prob_format(int format)
+{
+  get_context()->prob_format = format;
+}
+
+/*****************************************
+strongly connected components of the
+transition graph, by Tarjan's algorithm
+with an explicit stack. comp[i] is the
+component of state i. components are
+numbered in the order they complete, so
+every transition goes to a component of
+the same or a lower number. returns the
+number of components
+******************************************/
+int find_scc(csr_matrix_t *graph, int *comp)
+{
+  int i, v, w, n = graph->num_row;
+  int counter = 0, num_scc = 0;
+  int num_call = 0, num_stack = 0;
+  int *index = (int *)pow3_malloc((n + 1) * sizeof(int));
+  int *low = (int *)pow3_malloc((n + 1) * sizeof(int));
+  int *pos = (int *)pow3_malloc((n + 1) * sizeof(int));
+  int *call = (int *)pow3_malloc((n + 1) * sizeof(int));
+  int *stack = (int *)pow3_malloc((n + 1) * sizeof(int));
+
+  if(index == NULL || low == NULL || pos == NULL || call == NULL || stack == NULL) {
+    num_scc = UNDEFINE;
+    goto failure;
   }
 
   for(i = 0; i < n; i++) {
-    tmp_vec_plus[i]=0;
-    tmp_vec[i]=0;
-    steady_prob[i] = 0;
+    index[i] = UNDEFINE;
+    comp[i] = UNDEFINE;
   }
 
-  tmp_vec_plus[n] = 1;
-  
-  b = Padding(conditional, n);
-  bt = Transpose(b, n, n+1);
-  tmp_arr = Multiply(b, bt, n, n, n+1);
-  inverse(tmp_arr, n);
-  
+  for(i = 0; i < n; i++) {
+    if(index[i] != UNDEFINE)
+      continue;
+
+    index[i] = low[i] = counter++;
+    pos[i] = graph->row_ptr[i];
+    stack[num_stack++] = i;
+    call[num_call++] = i;
+
+    while(num_call > 0) {
+      v = call[num_call - 1];
+      if(pos[v] < graph->row_ptr[v + 1]) {
+	w = graph->col_idx[pos[v]++];
+	if(index[w] == UNDEFINE) {
+	  index[w] = low[w] = counter++;
+	  pos[w] = graph->row_ptr[w];
+	  stack[num_stack++] = w;
+	  call[num_call++] = w;
+	}
+	else if(comp[w] == UNDEFINE && index[w] < low[v])
+	  low[v] = index[w];
+	continue;
+      }
+
+      // v is done, it roots a component if nothing below reached higher
+      num_call--;
+      if(low[v] == index[v]) {
+	do {
+	  w = stack[--num_stack];
+	  comp[w] = num_scc;
+	} while(w != v);
+	num_scc++;
+      }
+      if(num_call > 0 && low[v] < low[call[num_call - 1]])
+	low[call[num_call - 1]] = low[v];
+    }
+  }
+
+ failure:
+  pow3_free(index);
+  pow3_free(low);
+  pow3_free(pos);
+  pow3_free(call);
+  pow3_free(stack);
+
+  return num_scc;
+}
+
+/*****************************************
+group the states by component: the states
+of component c are class_state[class_ptr[c]
+..class_ptr[c+1]), in increasing index, so
+every component is contiguous for the
+solvers. closed[c] is TRUE if no transition
+leaves component c
+******************************************/
+void get_scc_classes(csr_matrix_t *cond, int *comp, int num_scc, int *class_ptr, int *class_state, boolean *closed)
+{
+  int i, k, c, n = cond->num_row;
+
+  for(c = 0; c <= num_scc; c++)
+    class_ptr[c] = 0;
   for(i = 0; i < n; i++)
-    for(j=0; j <= n; j++)
-      tmp_vec[i] += tmp_vec_plus[j] * bt[j][i];
-  
+    class_ptr[comp[i] + 1]++;
+  for(c = 0; c < num_scc; c++)
+    class_ptr[c + 1] += class_ptr[c];
   for(i = 0; i < n; i++)
-    for(j = 0; j < n; j++)
-      steady_prob[i] += tmp_vec[j] * tmp_arr[j][i];
+    class_state[class_ptr[comp[i]]++] = i;
+  for(c = num_scc; c > 0; c--)
+    class_ptr[c] = class_ptr[c - 1];
+  class_ptr[0] = 0;
 
-  free(tmp_vec);
-  free(tmp_vec_plus);
-  for(i = 0; i < n; i++) {
-    free(b[i]);
-    free(bt[i]);
-    free(tmp_arr[i]);
+  for(c = 0; c < num_scc; c++)
+    closed[c] = TRUE;
+  for(i = 0; i < n; i++)
+    for(k = cond->row_ptr[i]; k < cond->row_ptr[i + 1]; k++)
+      if(comp[cond->col_idx[k]] != comp[i])
+	closed[comp[i]] = FALSE;
+}
+
+/*****************************************
+conditional probability matrix of the size
+states of a closed class, renumbered by
+their position in state[]
+******************************************/
+csr_matrix_t *get_class_matrix(csr_matrix_t *cond, int *state, int size, int *local)
+{
+  int i, k, nz = 0;
+  csr_matrix_t *sub = NULL;
+
+  for(i = 0; i < size; i++) {
+    local[state[i]] = i;
+    nz += cond->row_ptr[state[i] + 1] - cond->row_ptr[state[i]];
+  }
+
+  if((sub = alloc_csr_matrix(size, size, nz)) == NULL)
+    return NULL;
+
+  nz = 0;
+  for(i = 0; i < size; i++) {
+    sub->row_ptr[i] = nz;
+    for(k = cond->row_ptr[state[i]]; k < cond->row_ptr[state[i] + 1]; k++) {
+      sub->col_idx[nz] = local[cond->col_idx[k]];
+      sub->val[nz] = cond->val[k];
+      nz++;
+    }
+  }
+  sub->row_ptr[size] = nz;
+
+  return sub;
+}
+
+/*****************************************
+probability of ending in each closed class
+when starting from the reset state, or from
+any state alike if it is unknown. the mass
+flows through the transient components in
+topological order; inside one it is solved
+by Gauss-Seidel sweeps of x = m + x Q
+******************************************/
+boolean get_class_weight(fsm_t *fsm, csr_matrix_t *cond, int *comp, int num_scc, int *class_ptr, int *class_state, boolean *closed, double *weight)
+{
+  int i, j, k, c, m, iter, n = fsm->num_state;
+  int init_flag;
+  double sum, diag, diff, value;
+  double *mass = (double *)pow3_calloc(n, sizeof(double));
+  double *flow = (double *)pow3_calloc(n, sizeof(double));
+  csr_matrix_t *incoming = csr_transpose(cond);
+  state_t *init_state = get_fsm_init_state(fsm, &init_flag);
+
+  if(mass == NULL || flow == NULL || incoming == NULL) {
+    pow3_free(mass);
+    pow3_free(flow);
+    free_csr_matrix(incoming);
+    return FALSE;
+  }
+
+  if(init_flag == TRUE)
+    mass[init_state->index] = 1;
+  else
+    for(i = 0; i < n; i++)
+      mass[i] = 1.0 / n;
+
+  for(c = num_scc - 1; c >= 0; c--) {
+    weight[c] = 0;
+    if(closed[c]) {
+      for(m = class_ptr[c]; m < class_ptr[c + 1]; m++)
+	weight[c] += mass[class_state[m]];
+      continue;
+    }
+
+    for(iter = 0; iter < STEADY_MAX_ITER; iter++) {
+      diff = 0;
+      for(m = class_ptr[c]; m < class_ptr[c + 1]; m++) {
+	j = class_state[m];
+	sum = mass[j];
+	diag = 0;
+	for(k = incoming->row_ptr[j]; k < incoming->row_ptr[j + 1]; k++) {
+	  i = incoming->col_idx[k];
+	  if(i == j)
+	    diag = incoming->val[k];
+	  else if(comp[i] == c)
+	    sum += flow[i] * incoming->val[k];
+	}
+	value = sum / (1 - diag);
+	if(fabs(value - flow[j]) > diff)
+	  diff = fabs(value - flow[j]);
+	flow[j] = value;
+      }
+      if(diff < STEADY_TOLERANCE || class_ptr[c + 1] - class_ptr[c] == 1)
+	break;
+    }
+
+    for(m = class_ptr[c]; m < class_ptr[c + 1]; m++) {
+      i = class_state[m];
+      for(k = cond->row_ptr[i]; k < cond->row_ptr[i + 1]; k++)
+	if(comp[cond->col_idx[k]] != c)
+	  mass[cond->col_idx[k]] += flow[i] * cond->val[k];
+    }
   }
-  free(bt[n]);
-  free(b);
-  free(bt);
-  free(tmp_arr);
+
+  pow3_free(mass);
+  pow3_free(flow);
+  free_csr_matrix(incoming);
+
+  return TRUE;
+}
+
+/*****************************************
+steady state probability of one closed
+class with the selected solver
+******************************************/
+double *solve_class(csr_matrix_t *sub)
+{
+  dense_matrix_t *cond_prob = NULL;
+  double *class_prob = NULL;
+
+  // a single state, also a dead end, holds all the mass
+  if(sub->num_row == 1) {
+    if((class_prob = (double *)pow3_malloc(sizeof(double))) != NULL)
+      class_prob[0] = 1;
+    return class_prob;
+  }
+
+  if(get_context()->steady_method != STEADY_DENSE)
+    return get_steady_state_prob_sparse(sub, sub->num_row);
+
+  if((cond_prob = csr_to_dense(sub)) == NULL)
+    return NULL;
+  class_prob = get_steady_state_prob(cond_prob);
+  free_dense_matrix(cond_prob);
+
+  return class_prob;
+}
+
+/**********************************************
+steady state probability for the conditional
+probability matrix of a FSM, with the solver
+selected by set_steady_state_method. the
+states are split into strongly connected
+components: each closed class is solved on
+its own and scaled by the probability of
+ending in it, transient states get 0
+***********************************************/
+double *solve_steady_state(fsm_t *fsm, csr_matrix_t *cond)
+{
+  int k, c, size, n = fsm->num_state;
+  int num_scc, num_closed = 0, num_transient = 0;
+  int *comp = NULL;
+  int *class_ptr = NULL;
+  int *class_state = NULL;
+  int *local = NULL;
+  boolean *closed = NULL;
+  double *weight = NULL;
+  double *class_prob = NULL;
+  double *steady_prob = NULL;
+  csr_matrix_t *sub = NULL;
+
+  comp = (int *)pow3_malloc((n + 1) * sizeof(int));
+  class_ptr = (int *)pow3_malloc((n + 2) * sizeof(int));
+  class_state = (int *)pow3_malloc((n + 1) * sizeof(int));
+  local = (int *)pow3_malloc((n + 1) * sizeof(int));
+  closed = (boolean *)pow3_malloc((n + 1) * sizeof(boolean));
+  weight = (double *)pow3_malloc((n + 1) * sizeof(double));
+  steady_prob = (double *)pow3_calloc(n + 1, sizeof(double));
+  if(comp == NULL || class_ptr == NULL || class_state == NULL || local == NULL || closed == NULL || weight == NULL || steady_prob == NULL)
+    goto failure;
+
+  if((num_scc = find_scc(cond, comp)) == UNDEFINE)
+    goto failure;
+  get_scc_classes(cond, comp, num_scc, class_ptr, class_state, closed);
+  if(get_class_weight(fsm, cond, comp, num_scc, class_ptr, class_state, closed, weight) == FALSE)
+    goto failure;
+
+  for(c = 0; c < num_scc; c++) {
+    size = class_ptr[c + 1] - class_ptr[c];
+    if(closed[c] == FALSE) {
+      num_transient += size;
+      continue;
+    }
+    num_closed++;
+    // not reached from the reset state
+    if(weight[c] == 0)
+      continue;
+
+    if((sub = get_class_matrix(cond, &class_state[class_ptr[c]], size, local)) == NULL)
+      goto failure;
+    class_prob = solve_class(sub);
+    free_csr_matrix(sub);
+    if(class_prob == NULL)
+      goto failure;
+
+    for(k = 0; k < size; k++)
+      steady_prob[class_state[class_ptr[c] + k]] = weight[c] * class_prob[k];
+    pow3_free(class_prob);
+  }
+
+  if(num_scc > 1)
+    pow3_log("Markov chain: %d closed classes, %d transient states.\n", num_closed, num_transient);
+
+  pow3_free(comp);
+  pow3_free(class_ptr);
+  pow3_free(class_state);
+  pow3_free(local);
+  pow3_free(closed);
+  pow3_free(weight);
 
   return steady_prob;
+
+ failure:
+  pow3_free(comp);
+  pow3_free(class_ptr);
+  pow3_free(class_state);
+  pow3_free(local);
+  pow3_free(closed);
+  pow3_free(weight);
+  pow3_free(steady_prob);
+
+  return NULL;
 }
 
 /**********************************************
 calcualte the total transition probability 
 based on steady state probability and conditional
-transition probability
+transition probability, as a sparse matrix.
+a FSM with a probability file takes them from it
 ***********************************************/
-double **get_trans_prob(fsm_t *fsm)
+csr_matrix_t *get_trans_prob_csr(fsm_t *fsm)
 {
-  int i, j, n;
-  double **cond_prob = NULL;
-  double **trans_prob = NULL;
+  int i, k;
+  csr_matrix_t *trans_prob = NULL;
   double *steady_prob = NULL;
-  
-  n = fsm->num_state;
-  cond_prob = get_cond_trans_prob(fsm);
-  
-  if(cond_prob == NULL)
+
+  if(fsm->prob_file)
+    return read_trans_prob(fsm->prob_file, fsm->num_state);
+
+  if((trans_prob = get_cond_trans_csr(fsm)) == NULL)
     return NULL;
 
-  trans_prob = (double **)calloc(n, sizeof(double *));
-  steady_prob = (double *)calloc(n, sizeof(double));
-  
-  for(i = 0; i < n; i++) {
-    trans_prob[i] = (double *)calloc(n, sizeof(double));
-    steady_prob[i] = 0;
-    for(j = 0; j < n; j++)
-      trans_prob[i][j] = 0;
+  if((steady_prob = solve_steady_state(fsm, trans_prob)) == NULL) {
+    free_csr_matrix(trans_prob);
+    return NULL;
   }
-  
-  steady_prob = get_steady_state_prob(cond_prob, n);
-  
-  for(i = 0; i < n; i++) {
+
+  for(i = 0; i < fsm->num_state; i++) {
     if(steady_prob[i] < 0) {
-      printf("ERROR: steady state probability of state %s is less than 0.\n", fsm->state[i].name);
-      printf("The FSM may not be reducible and not applicable to Markov chain model.\n");
+      pow3_log("ERROR: steady state probability of state %s is less than 0.\n", fsm->state[i].name);
+      pow3_log("The FSM may not be reducible and not applicable to Markov chain model.\n");
     }
-    for(j = 0; j < n; j++)
-      trans_prob[i][j] = cond_prob[i][j] * steady_prob[i];
+    for(k = trans_prob->row_ptr[i]; k < trans_prob->row_ptr[i + 1]; k++)
+      trans_prob->val[k] *= steady_prob[i];
   }
-  free(cond_prob);
-  free(steady_prob);
+  pow3_free(steady_prob);
+
+  return trans_prob;
+}
+
+/**********************************************
+calcualte the total transition probability 
+as a dense n x n matrix
+***********************************************/
+dense_matrix_t *get_trans_prob(fsm_t *fsm)
+{
+  int i, k, n;
+  csr_matrix_t *trans_csr = NULL;
+  dense_matrix_t *trans_prob = NULL;
+  
+  n = fsm->num_state;
+
+  if((trans_csr = get_trans_prob_csr(fsm)) == NULL)
+    return NULL;
+
+  if((trans_prob = alloc_dense_matrix(n, n)) != NULL) {
+    for(i = 0; i < n; i++)
+      for(k = trans_csr->row_ptr[i]; k < trans_csr->row_ptr[i + 1]; k++)
+	DENSE_ELEM(trans_prob, i, trans_csr->col_idx[k]) = trans_csr->val[k];
+  }
+
+  free_csr_matrix(trans_csr);
   
   return trans_prob;
 }
@@ -194,7 +793,7 @@ int hamming_distance(char *s1, char *s2, int n)
   int result = 0;
 
   if(s1 == NULL || s2 == NULL) {
-    printf("ERROR: Cannot compute HAMMING distance between NULL vectors.\n");
+    pow3_error(POW3_ERR_ARGUMENT, "ERROR: Cannot compute HAMMING distance between NULL vectors.\n");
     return -1;
   } 
 
@@ -205,6 +804,64 @@ int hamming_distance(char *s1, char *s2, int n)
   return result;
 }
 
+/********************************************
+switching activity of the state codes of a
+FSM for its total transition probabilities
+*********************************************/
+double get_code_switching(fsm_t *fsm, csr_matrix_t *trans_prob)
+{
+  int i, k;
+  double total_sw = 0;
+
+  for(i = 0; i < fsm->num_state; i++)
+    for(k = trans_prob->row_ptr[i]; k < trans_prob->row_ptr[i + 1]; k++)
+      total_sw += hamming_distance_bits(fsm->state[i].code_bits, fsm->state[trans_prob->col_idx[k]].code_bits, fsm->code_words) * trans_prob->val[k];
+
+  return total_sw;
+}
+
+/********************************************
+write the total transition probabilities in
+the format of the context: a sparse matrix
+file, or a .prob text file with row i
+holding the probability of every transition
+out of state i
+*********************************************/
+boolean write_trans_prob(char *file_name, csr_matrix_t *trans_prob)
+{
+  int i, j, k;
+  int n = trans_prob->num_row;
+  double *row = NULL;
+  FILE *ofp = NULL;
+
+  if(get_context()->prob_format == PROB_BINARY)
+    return write_csr_file(file_name, trans_prob);
+
+  if((ofp = fopen(file_name, "w")) == NULL) {
+    pow3_error(POW3_ERR_IO, "ERROR: cannot open output probability file %s\n", file_name);
+    return FALSE;
+  }
+  if((row = (double *)pow3_calloc(n + 1, sizeof(double))) == NULL) {
+    fclose(ofp);
+    return FALSE;
+  }
+
+  for(i = 0; i < n; i++) {
+    for(k = trans_prob->row_ptr[i]; k < trans_prob->row_ptr[i + 1]; k++)
+      row[trans_prob->col_idx[k]] = trans_prob->val[k];
+    for(j = 0; j < n; j++)
+      fprintf(ofp, "%.4f ", row[j]);
+    fprintf(ofp, "\n");
+    for(k = trans_prob->row_ptr[i]; k < trans_prob->row_ptr[i + 1]; k++)
+      row[trans_prob->col_idx[k]] = 0;
+  }
+
+  fclose(ofp);
+  pow3_free(row);
+
+  return TRUE;
+}
+
 /********************************************
 calculate the switching activity in a FSM
 based on the total transition probability
@@ -212,43 +869,183 @@ based on the total transition probability
 boolean get_switching_activity(fsm_t *fsm, double *total_sw, boolean print_prob)
 {
   boolean ret_flag = TRUE;
-  int ham_dist = 0;
-  int i, j;
-  double **transition = NULL;
+  int i;
+  csr_matrix_t *transition = NULL;
   char file_name[128];
-  FILE *ofp = NULL;
 
-  transition = get_trans_prob(fsm);
+  for(i = 0; i < fsm->num_state; i++) {
+    if(fsm->state[i].code_bits == NULL) {
+      pow3_error(POW3_ERR_ARGUMENT, "ERROR: Cannot compute HAMMING distance between NULL vectors.\n");
+      return FALSE;
+    }
+  }
+
+  transition = get_trans_prob_csr(fsm);
   
   if(transition == NULL)
     return FALSE;
+
+  *total_sw += get_code_switching(fsm, transition);
   
   if(print_prob == TRUE) {
-    sprintf(file_name, "%s.prob", fsm->name);
-    if((ofp = fopen(file_name, "w")) == NULL)
-      printf("ERROR: cannot open output probability file %s\n", file_name);
+    sprintf(file_name, "%s.%s", fsm->name, get_context()->prob_format == PROB_BINARY ? "bprob" : "prob");
+    write_trans_prob(file_name, transition);
   }
+
+  free_csr_matrix(transition);
   
-  for(i = 0; i < fsm->num_state; i++) {
-    for(j = 0; j < fsm->num_state; j++) {
-      ham_dist = hamming_distance(fsm->state[i].code, fsm->state[j].code, fsm->num_state);
-      if(ham_dist == -1) {
-	ret_flag = FALSE;
+  return ret_flag;
+}
+
+/********************************************
+the next number of a .prob file in [p, end),
+p moved behind it. FALSE at the end of the
+line or on something else than a number
+*********************************************/
+boolean next_prob_token(char **p, char *end, double *value)
+{
+  char num[64];
+  char *num_end;
+  char *tok;
+  int len;
+
+  while(*p < end && (**p == ' ' || **p == '\t' || **p == '\r'))
+    (*p)++;
+  tok = *p;
+  while(*p < end && **p != ' ' && **p != '\t' && **p != '\r' && **p != '\n')
+    (*p)++;
+  len = *p - tok;
+  if(len == 0 || len >= (int)sizeof(num))
+    return FALSE;
+
+  memcpy(num, tok, len);
+  num[len] = '\0';
+  *value = strtod(num, &num_end);
+
+  return num_end == num + len;
+}
+
+/********************************************
+read the total transition probabilities of
+the n states of a FSM, of any number of
+states if n is UNDEFINE, from a file as
+write_trans_prob writes it, in either
+format. of a .prob text file only the
+nonzero entries are kept
+*********************************************/
+csr_matrix_t *read_trans_prob(char *file_name, int n)
+{
+  int i, j, nz = 0;
+  int fd = -1;
+  struct stat file_stat;
+  char *map = NULL;
+  char *p, *end, *line_end;
+  double value, total = 0;
+  csr_matrix_t *trans_prob = NULL;
+
+  if((fd = open(file_name, O_RDONLY)) < 0 || fstat(fd, &file_stat) < 0) {
+    pow3_error(POW3_ERR_IO, "ERROR: Cannot open probability file %s\n", file_name);
+    if(fd >= 0)
+      close(fd);
+    return NULL;
+  }
+  if(file_stat.st_size == 0) {
+    pow3_error(POW3_ERR_PARSE, "ERROR: probability file %s is empty.\n", file_name);
+    close(fd);
+    return NULL;
+  }
+  map = (char *)mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if(map == MAP_FAILED) {
+    pow3_error(POW3_ERR_IO, "ERROR: Cannot map probability file %s\n", file_name);
+    close(fd);
+    return NULL;
+  }
+  end = map + file_stat.st_size;
+
+  if(is_csr_image(map, file_stat.st_size)) {
+    if((trans_prob = read_csr_image(map, file_stat.st_size)) == NULL)
+      goto failure;
+    if(trans_prob->num_row != trans_prob->num_col || (n != UNDEFINE && trans_prob->num_row != n)) {
+      pow3_error(POW3_ERR_PARSE, "ERROR: %s is a %d x %d matrix, %d states expected.\n", file_name, trans_prob->num_row, trans_prob->num_col, n);
+      goto failure;
+    }
+    for(i = 0; i < trans_prob->num_nz; i++)
+      total += trans_prob->val[i];
+    if(fabs(total - 1) > 1e-6)
+      pow3_log("Warning: the transition probabilities of %s add up to %.6f, not 1.\n", file_name, total);
+    goto done;
+  }
+
+  // the states of a text file are the entries of its first line
+  if(n == UNDEFINE) {
+    if((line_end = (char *)memchr(map, '\n', end - map)) == NULL)
+      line_end = end;
+    for(n = 0, p = map; next_prob_token(&p, line_end, &value) == TRUE; n++);
+    if(n == 0) {
+      pow3_error(POW3_ERR_PARSE, "ERROR: %s has no probabilities.\n", file_name);
+      goto failure;
+    }
+  }
+
+  // the nonzero entries have a nonzero digit
+  for(p = map; p < end; p++) {
+    if(*p >= '1' && *p <= '9') {
+      nz++;
+      while(p < end && *p != ' ' && *p != '\t' && *p != '\n')
+	p++;
+    }
+  }
+  if((trans_prob = alloc_csr_matrix(n, n, nz)) == NULL)
+    goto failure;
+
+  nz = 0;
+  p = map;
+  for(i = 0; i < n; i++) {
+    if(p >= end || (line_end = (char *)memchr(p, '\n', end - p)) == NULL)
+      line_end = end;
+    trans_prob->row_ptr[i] = nz;
+    for(j = 0; j < n; j++) {
+      if(next_prob_token(&p, line_end, &value) == FALSE || value < 0) {
+	pow3_error(POW3_ERR_PARSE, "ERROR: entry %d of row %d of %s is not a probability, %d states expected.\n", j, i, file_name, n);
 	goto failure;
       }
-
-      *total_sw += ham_dist * transition[i][j];
-      if(ofp)
-	fprintf(ofp, "%.4f ", transition[i][j]);
+      if(value > 0) {
+	trans_prob->col_idx[nz] = j;
+	trans_prob->val[nz] = value;
+	nz++;
+	total += value;
+      }
+    }
+    if(next_prob_token(&p, line_end, &value) == TRUE) {
+      pow3_error(POW3_ERR_PARSE, "ERROR: row %d of %s has more than %d entries.\n", i, file_name, n);
+      goto failure;
+    }
+    p = line_end + 1;
+  }
+  for(; p < end; p++) {
+    if(*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+      pow3_error(POW3_ERR_PARSE, "ERROR: %s has more than %d rows.\n", file_name, n);
+      goto failure;
     }
-    if(ofp)
-      fprintf(ofp, "\n");
   }
+  trans_prob->row_ptr[n] = nz;
+  trans_prob->num_nz = nz;
 
- failure: 
-  for(i = 0; i < fsm->num_state; i++)
-    free(transition[i]);
-  free(transition);
-  
-  return ret_flag;
+  // the text has 4 digits per entry
+  if(fabs(total - 1) > 1e-2)
+    pow3_log("Warning: the transition probabilities of %s add up to %.4f, not 1.\n", file_name, total);
+
+ done:
+  munmap(map, file_stat.st_size);
+  close(fd);
+
+  return trans_prob;
+
+ failure:
+  if(trans_prob)
+    free_csr_matrix(trans_prob);
+  munmap(map, file_stat.st_size);
+  close(fd);
+
+  return NULL;
 }
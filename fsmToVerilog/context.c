@@ -0,0 +1,271 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdint.h>
+#include "global.h"
+#include "struct.h"
+#include "context.h"
+
+void *libc_malloc(size_t size, void *user)
+{
+  (void)user;
+  return malloc(size);
+}
+
+void *libc_realloc(void *ptr, size_t size, void *user)
+{
+  (void)user;
+  return realloc(ptr, size);
+}
+
+void libc_free(void *ptr, void *user)
+{
+  (void)user;
+  free(ptr);
+}
+
+// context of the command line tools
+pow3_ctx_t _default_context = {{libc_malloc, libc_realloc, libc_free, NULL}, NULL, 0, STEADY_SPARSE, PROB_TEXT, POW3_OK, ""};
+
+// context entered by the current thread
+__thread pow3_ctx_t *_current_context = NULL;
+
+/**********************************
+a new context with the given memory
+routines, or malloc/free if NULL.
+it is quiet until a log is set
+**********************************/
+pow3_ctx_t *new_context(pow3_allocator_t *allocator)
+{
+  pow3_ctx_t *ctx = NULL;
+
+  if(allocator)
+    ctx = (pow3_ctx_t *)allocator->malloc(sizeof(pow3_ctx_t), allocator->user);
+  else
+    ctx = (pow3_ctx_t *)malloc(sizeof(pow3_ctx_t));
+  if(ctx == NULL)
+    return NULL;
+
+  memset(ctx, 0, sizeof(pow3_ctx_t));
+  ctx->allocator = allocator ? *allocator : _default_context.allocator;
+  ctx->log = NULL;
+  ctx->quiet = TRUE;
+  ctx->steady_method = STEADY_SPARSE;
+  ctx->prob_format = PROB_TEXT;
+  ctx->error = POW3_OK;
+
+  return ctx;
+}
+
+void free_context(pow3_ctx_t *ctx)
+{
+  if(ctx)
+    ctx->allocator.free(ctx, ctx->allocator.user);
+}
+
+/**********************************
+make ctx the context of the calling
+thread and clear its error. returns
+the context to give back to
+leave_context()
+**********************************/
+pow3_ctx_t *enter_context(pow3_ctx_t *ctx)
+{
+  pow3_ctx_t *prev = _current_context;
+
+  _current_context = ctx;
+  ctx->error = POW3_OK;
+  ctx->message[0] = '\0';
+
+  return prev;
+}
+
+void leave_context(pow3_ctx_t *prev)
+{
+  _current_context = prev;
+}
+
+pow3_ctx_t *get_context(void)
+{
+  return _current_context ? _current_context : &_default_context;
+}
+
+/**********************************
+memory of the current context. a
+failed allocation is recorded as
+POW3_ERR_MEMORY
+**********************************/
+void *pow3_malloc(size_t size)
+{
+  pow3_ctx_t *ctx = get_context();
+  void *ptr = ctx->allocator.malloc(size > 0 ? size : 1, ctx->allocator.user);
+
+  if(ptr == NULL)
+    pow3_error(POW3_ERR_MEMORY, "ERROR: cannot allocate %lu bytes.\n", (unsigned long)size);
+
+  return ptr;
+}
+
+void *pow3_calloc(size_t num, size_t size)
+{
+  void *ptr = NULL;
+
+  if(size > 0 && num > SIZE_MAX / size) {
+    pow3_error(POW3_ERR_MEMORY, "ERROR: cannot allocate %lu x %lu bytes.\n", (unsigned long)num, (unsigned long)size);
+    return NULL;
+  }
+
+  if((ptr = pow3_malloc(num * size)) != NULL)
+    memset(ptr, 0, num * size);
+
+  return ptr;
+}
+
+void *pow3_realloc(void *ptr, size_t size)
+{
+  pow3_ctx_t *ctx = get_context();
+  void *new_ptr = ctx->allocator.realloc(ptr, size > 0 ? size : 1, ctx->allocator.user);
+
+  if(new_ptr == NULL)
+    pow3_error(POW3_ERR_MEMORY, "ERROR: cannot allocate %lu bytes.\n", (unsigned long)size);
+
+  return new_ptr;
+}
+
+void pow3_free(void *ptr)
+{
+  pow3_ctx_t *ctx = get_context();
+
+  if(ptr)
+    ctx->allocator.free(ptr, ctx->allocator.user);
+}
+
+FILE *get_log(pow3_ctx_t *ctx)
+{
+  if(ctx->log)
+    return ctx->log;
+  return ctx->quiet ? NULL : stdout;
+}
+
+/**********************************
+print a message to the log of the
+current context
+**********************************/
+void pow3_log(const char *format, ...)
+{
+  FILE *fp = get_log(get_context());
+  va_list args;
+
+  if(fp == NULL)
+    return;
+
+  va_start(args, format);
+  vfprintf(fp, format, args);
+  va_end(args);
+}
+
+/**********************************
+report an error: the first one is
+kept in the current context, and
+all are printed to its log. the
+default context only prints, as it
+is shared by all the threads
+**********************************/
+void pow3_error(int error, const char *format, ...)
+{
+  pow3_ctx_t *ctx = get_context();
+  FILE *fp = get_log(ctx);
+  va_list args;
+  int len;
+
+  if(ctx != &_default_context && ctx->error == POW3_OK) {
+    ctx->error = error;
+    va_start(args, format);
+    vsnprintf(ctx->message, POW3_MESSAGE_LEN, format, args);
+    va_end(args);
+    len = strlen(ctx->message);
+    if(len > 0 && ctx->message[len - 1] == '\n')
+      ctx->message[len - 1] = '\0';
+  }
+
+  if(fp) {
+    va_start(args, format);
+    vfprintf(fp, format, args);
+    va_end(args);
+  }
+}
+
+/**********************************
+an empty arena, its first block of
+size bytes (ARENA_BLOCK_SIZE if 0)
+is taken on the first allocation.
+its blocks come from the allocator
+of the current context, whichever
+context the arena is used in later
+**********************************/
+void init_arena(pow3_arena_t *arena, size_t size)
+{
+  arena->block = NULL;
+  arena->block_size = size > 0 ? size : ARENA_BLOCK_SIZE;
+  arena->total = 0;
+  arena->allocator = get_context()->allocator;
+}
+
+/**********************************
+size zeroed bytes aligned on
+ARENA_ALIGN, NULL if out of
+memory
+**********************************/
+void *arena_alloc(pow3_arena_t *arena, size_t size)
+{
+  pow3_arena_block_t *block = arena->block;
+  size_t header = (sizeof(pow3_arena_block_t) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  char *ptr;
+
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  if(size == 0)
+    size = ARENA_ALIGN;
+
+  if(block == NULL || block->size - block->used < size) {
+    while(arena->block_size < size)
+      arena->block_size *= 2;
+    if((block = (pow3_arena_block_t *)arena->allocator.malloc(header + arena->block_size, arena->allocator.user)) == NULL) {
+      pow3_error(POW3_ERR_MEMORY, "ERROR: cannot allocate %lu bytes.\n", (unsigned long)(header + arena->block_size));
+      return NULL;
+    }
+    block->next = arena->block;
+    block->size = arena->block_size;
+    block->used = 0;
+    arena->block = block;
+    arena->block_size *= 2;
+  }
+
+  ptr = (char *)block + header + block->used;
+  block->used += size;
+  arena->total += size;
+  memset(ptr, 0, size);
+
+  return ptr;
+}
+
+char *arena_strdup(pow3_arena_t *arena, char *str)
+{
+  char *copy = (char *)arena_alloc(arena, strlen(str) + 1);
+
+  if(copy)
+    strcpy(copy, str);
+  return copy;
+}
+
+void free_arena(pow3_arena_t *arena)
+{
+  pow3_arena_block_t *block, *next;
+
+  for(block = arena->block; block; block = next) {
+    next = block->next;
+    arena->allocator.free(block, arena->allocator.user);
+  }
+  arena->block = NULL;
+  arena->total = 0;
+}
@@ -0,0 +1,92 @@
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+/*
+ * The context of the FSM routines: where their memory
+ * comes from, where their messages go and the first
+ * error they ran into. Every thread works in its own
+ * current context; without one it uses the default
+ * context of the command line tools (malloc/free and
+ * messages on stdout).
+ *
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+
+// error codes
+#define POW3_OK             0
+#define POW3_ERR_ARGUMENT   1
+#define POW3_ERR_MEMORY     2
+#define POW3_ERR_IO         3
+#define POW3_ERR_PARSE      4
+#define POW3_ERR_MARKOV     5  // no steady state: unreachable or dead end states
+#define POW3_ERR_SINGULAR   6
+#define POW3_ERR_ENCODE     7
+
+#define POW3_MESSAGE_LEN    256
+
+#define ARENA_BLOCK_SIZE    65536  // bytes of the first arena block
+#define ARENA_ALIGN         16
+
+/**********************************
+memory routines given by the user,
+user is passed back on every call
+**********************************/
+typedef struct pow3_allocator_struct {
+  void *(*malloc)(size_t size, void *user);
+  void *(*realloc)(void *ptr, size_t size, void *user);
+  void (*free)(void *ptr, void *user);
+  void *user;
+} pow3_allocator_t;
+
+typedef struct pow3_ctx_struct {
+  pow3_allocator_t allocator;
+  FILE *log;            // messages go here if set
+  int quiet;            // else to stdout unless quiet
+  int steady_method;    // STEADY_SPARSE or STEADY_DENSE
+  int prob_format;      // PROB_TEXT or PROB_BINARY, of the probability files written
+  int error;            // first error since the context was entered
+  char message[POW3_MESSAGE_LEN];
+} pow3_ctx_t;
+
+/**********************************
+bump arena: memory handed out from
+the top of the current block, all
+of it freed at once with the arena.
+older blocks are chained behind.
+the blocks come from the allocator
+of the context that made the arena
+**********************************/
+typedef struct pow3_arena_block_struct {
+  struct pow3_arena_block_struct *next;
+  size_t size;          // bytes of data
+  size_t used;
+} pow3_arena_block_t;
+
+typedef struct pow3_arena_struct {
+  pow3_arena_block_t *block;
+  size_t block_size;    // size of the next block, doubles as it grows
+  size_t total;         // bytes handed out
+  pow3_allocator_t allocator;
+} pow3_arena_t;
+
+/*************** begin context function proto declaration *************/
+extern pow3_ctx_t *new_context(pow3_allocator_t *allocator);
+extern void free_context(pow3_ctx_t *ctx);
+extern pow3_ctx_t *enter_context(pow3_ctx_t *ctx);
+extern void leave_context(pow3_ctx_t *prev);
+extern pow3_ctx_t *get_context(void);
+extern void *pow3_malloc(size_t size);
+extern void *pow3_calloc(size_t num, size_t size);
+extern void *pow3_realloc(void *ptr, size_t size);
+extern void pow3_free(void *ptr);
+extern void pow3_log(const char *format, ...);
+extern void pow3_error(int error, const char *format, ...);
+extern void init_arena(pow3_arena_t *arena, size_t size);
+extern void *arena_alloc(pow3_arena_t *arena, size_t size);
+extern char *arena_strdup(pow3_arena_t *arena, char *str);
+extern void free_arena(pow3_arena_t *arena);
+/*************** end context function proto declaration ***************/
+
+#endif
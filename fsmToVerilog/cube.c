@@ -0,0 +1,433 @@
+/*
+ * Bit-packed cube operations on the transition
+ * inputs and outputs of a FSM. A cube of n literals
+ * is stored in NUM_WORDS(n) care words and 
+ * NUM_WORDS(n) value words.
+ *
+ * State codes are packed the same way, one bit per
+ * code bit, so that HAMMING distances are XOR and
+ * popcount over a few words.
+ *
+ * The probability of an input cube is a product of
+ * byte tables over its packed 1 and 0 literals, or
+ * a sum over the input vectors it contains.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "struct.h"
+#include "global.h"
+#include "context.h"
+
+/*************** begin forward function proto declaration *************/
+void encode_cube(char *str, int n, cube_t *cube);
+boolean build_fsm_cubes(fsm_t *fsm);
+int cube_num_dontcare(cube_t *cube, int n);
+boolean cube_is_care(cube_t *cube, int k);
+char cube_literal(cube_t *cube, int k);
+boolean cube_intersect(cube_t *a, cube_t *b, int n);
+boolean cube_equal(cube_t *a, cube_t *b, int n);
+boolean set_input_prob(fsm_t *fsm, double *one);
+boolean set_input_vectors(fsm_t *fsm, int num_vector, uint64_t *vector, double *weight);
+double cube_prob(cube_t *cube, input_prob_t *input_prob, int n);
+void pack_code(char *code, int num_words, uint64_t *bits);
+boolean pack_fsm_codes(fsm_t *fsm);
+int hamming_distance_bits(uint64_t *a, uint64_t *b, int num_words);
+int rising_bits(uint64_t *a, uint64_t *b, int num_words);
+int falling_bits(uint64_t *a, uint64_t *b, int num_words);
+/*************** end forward function proto declaration **************/
+
+/*******************************************
+pack a string of '0'/'1'/'-' into a cube
+whose words are already allocated
+********************************************/
+void encode_cube(char *str, int n, cube_t *cube)
+{
+  int k;
+  uint64_t bit;
+
+  memset(cube->care, 0, NUM_WORDS(n) * sizeof(uint64_t));
+  memset(cube->value, 0, NUM_WORDS(n) * sizeof(uint64_t));
+
+  for(k = 0; k < n && str[k] != '\0'; k++) {
+    bit = (uint64_t)1 << (k % WORD_BITS);
+    if(str[k] == '0')
+      cube->care[k / WORD_BITS] |= bit;
+    else if(str[k] == '1') {
+      cube->care[k / WORD_BITS] |= bit;
+      cube->value[k / WORD_BITS] |= bit;
+    }
+  }
+}
+
+/*******************************************
+fill in the packed input and output cubes 
+of all transitions, in one block of words
+from the arena of the FSM
+********************************************/
+boolean build_fsm_cubes(fsm_t *fsm)
+{
+  int i;
+  int in_words = NUM_WORDS(fsm->num_input);
+  int out_words = NUM_WORDS(fsm->num_output);
+  int trans_words = 2 * (in_words + out_words);
+  uint64_t *words;
+
+  fsm->cube_words = NULL;
+
+  if(fsm->num_transition == 0 || trans_words == 0)
+    return TRUE;
+
+  fsm->cube_words = (uint64_t *)arena_alloc(&fsm->arena, (size_t)fsm->num_transition * trans_words * sizeof(uint64_t));
+  if(fsm->cube_words == NULL) {
+    pow3_error(POW3_ERR_MEMORY, "ERROR: cannot allocate the packed cubes.\n");
+    return FALSE;
+  }
+
+  for(i = 0; i < fsm->num_transition; i++) {
+    words = fsm->cube_words + (size_t)i * trans_words;
+    fsm->transition[i].in_cube.care = words;
+    fsm->transition[i].in_cube.value = words + in_words;
+    fsm->transition[i].out_cube.care = words + 2 * in_words;
+    fsm->transition[i].out_cube.value = words + 2 * in_words + out_words;
+    if(fsm->transition[i].input)
+      encode_cube(fsm->transition[i].input, fsm->num_input, &fsm->transition[i].in_cube);
+    if(fsm->transition[i].output)
+      encode_cube(fsm->transition[i].output, fsm->num_output, &fsm->transition[i].out_cube);
+  }
+
+  return TRUE;
+}
+
+/*******************************************
+number of don't care literals in a cube
+********************************************/
+int cube_num_dontcare(cube_t *cube, int n)
+{
+  int w;
+  int num_care = 0;
+
+  for(w = 0; w < NUM_WORDS(n); w++)
+    num_care += POPCOUNT(cube->care[w]);
+
+  return n - num_care;
+}
+
+boolean cube_is_care(cube_t *cube, int k)
+{
+  return (cube->care[k / WORD_BITS] >> (k % WORD_BITS)) & 1;
+}
+
+/*******************************************
+the k-th literal of a cube as '0'/'1'/'-'
+********************************************/
+char cube_literal(cube_t *cube, int k)
+{
+  if(!cube_is_care(cube, k))
+    return '-';
+  return ((cube->value[k / WORD_BITS] >> (k % WORD_BITS)) & 1) ? '1' : '0';
+}
+
+/*******************************************
+two cubes intersect unless some literal is
+cared by both with different values
+********************************************/
+boolean cube_intersect(cube_t *a, cube_t *b, int n)
+{
+  int w;
+
+  for(w = 0; w < NUM_WORDS(n); w++)
+    if(a->care[w] & b->care[w] & (a->value[w] ^ b->value[w]))
+      return FALSE;
+
+  return TRUE;
+}
+
+boolean cube_equal(cube_t *a, cube_t *b, int n)
+{
+  int w;
+
+  for(w = 0; w < NUM_WORDS(n); w++)
+    if(a->care[w] != b->care[w] || (a->value[w] & a->care[w]) != (b->value[w] & b->care[w]))
+      return FALSE;
+
+  return TRUE;
+}
+
+/*******************************************
+independent signal probabilities of the
+inputs of a FSM, one[k] the probability
+that input k is 1. the tables of an earlier
+call are reused, so that switching to
+another workload allocates nothing
+********************************************/
+boolean set_input_prob(fsm_t *fsm, double *one)
+{
+  int k, b, m;
+  int num_input = fsm->num_input;
+  int num_byte = 8 * NUM_WORDS(num_input);
+  double p;
+  input_prob_t *input_prob = fsm->input_prob;
+
+  for(k = 0; k < num_input; k++) {
+    if(!(one[k] >= 0 && one[k] <= 1)) {
+      pow3_error(POW3_ERR_ARGUMENT, "ERROR: probability %g of input %d is not in [0, 1].\n", one[k], k);
+      return FALSE;
+    }
+  }
+
+  if(input_prob == NULL)
+    input_prob = (input_prob_t *)arena_alloc(&fsm->arena, sizeof(input_prob_t));
+  if(input_prob && input_prob->one_table == NULL) {
+    input_prob->one = (double *)arena_alloc(&fsm->arena, (num_input + 1) * sizeof(double));
+    input_prob->one_table = (double *)arena_alloc(&fsm->arena, (size_t)(num_byte + 1) * 256 * sizeof(double));
+    input_prob->zero_table = (double *)arena_alloc(&fsm->arena, (size_t)(num_byte + 1) * 256 * sizeof(double));
+  }
+  if(input_prob == NULL || input_prob->one == NULL || input_prob->one_table == NULL || input_prob->zero_table == NULL) {
+    pow3_error(POW3_ERR_MEMORY, "ERROR: cannot allocate the input probabilities.\n");
+    return FALSE;
+  }
+
+  input_prob->num_input = num_input;
+  input_prob->num_vector = 0;
+  memcpy(input_prob->one, one, num_input * sizeof(double));
+
+  // entry m is entry m without its lowest bit, times that input
+  for(b = 0; b < num_byte; b++) {
+    input_prob->one_table[b * 256] = 1;
+    input_prob->zero_table[b * 256] = 1;
+    for(m = 1; m < 256; m++) {
+      k = 8 * b + __builtin_ctz(m);
+      p = k < num_input ? one[k] : 1;
+      input_prob->one_table[b * 256 + m] = input_prob->one_table[b * 256 + (m & (m - 1))] * p;
+      input_prob->zero_table[b * 256 + m] = input_prob->zero_table[b * 256 + (m & (m - 1))] * (k < num_input ? 1 - p : 1);
+    }
+  }
+
+  fsm->input_prob = input_prob;
+
+  return TRUE;
+}
+
+/*******************************************
+empirical distribution of the inputs of a
+FSM: num_vector packed input vectors and
+their weights, like the number of times
+each was seen. the weights are normalized.
+the arrays of an earlier distribution are
+reused when they are large enough, else
+replaced, so that a FSM given workload
+after workload does not grow
+********************************************/
+boolean set_input_vectors(fsm_t *fsm, int num_vector, uint64_t *vector, double *weight)
+{
+  int v;
+  int num_words = NUM_WORDS(fsm->num_input);
+  double total = 0;
+  uint64_t *new_vector = NULL;
+  double *new_prob = NULL;
+  input_prob_t *input_prob = fsm->input_prob;
+  pow3_allocator_t *allocator = &fsm->arena.allocator;
+
+  for(v = 0; v < num_vector; v++) {
+    if(!(weight[v] >= 0)) {
+      pow3_error(POW3_ERR_ARGUMENT, "ERROR: weight %g of input vector %d is negative.\n", weight[v], v);
+      return FALSE;
+    }
+    total += weight[v];
+  }
+  if(num_vector == 0 || total == 0) {
+    pow3_error(POW3_ERR_ARGUMENT, "ERROR: the input distribution has no weight.\n");
+    return FALSE;
+  }
+
+  if(input_prob == NULL)
+    input_prob = (input_prob_t *)arena_alloc(&fsm->arena, sizeof(input_prob_t));
+  if(input_prob && input_prob->max_vector < num_vector) {
+    // with the allocator of the FSM, whichever context sets them
+    new_vector = (uint64_t *)allocator->malloc(((size_t)num_vector * num_words + 1) * sizeof(uint64_t), allocator->user);
+    new_prob = (double *)allocator->malloc(num_vector * sizeof(double), allocator->user);
+    if(new_vector && new_prob) {
+      if(input_prob->max_vector > 0) {
+	allocator->free(input_prob->vector, allocator->user);
+	allocator->free(input_prob->vector_prob, allocator->user);
+      }
+      input_prob->vector = new_vector;
+      input_prob->vector_prob = new_prob;
+      input_prob->max_vector = num_vector;
+    }
+    else {
+      if(new_vector)
+	allocator->free(new_vector, allocator->user);
+      if(new_prob)
+	allocator->free(new_prob, allocator->user);
+    }
+  }
+  if(input_prob == NULL || input_prob->max_vector < num_vector) {
+    pow3_error(POW3_ERR_MEMORY, "ERROR: cannot allocate the input distribution.\n");
+    return FALSE;
+  }
+
+  input_prob->num_input = fsm->num_input;
+  input_prob->num_vector = num_vector;
+  memcpy(input_prob->vector, vector, (size_t)num_vector * num_words * sizeof(uint64_t));
+  for(v = 0; v < num_vector; v++)
+    input_prob->vector_prob[v] = weight[v] / total;
+
+  fsm->input_prob = input_prob;
+
+  return TRUE;
+}
+
+/*******************************************
+probability that the inputs fall in a cube:
+the sum over the input vectors it contains,
+or the product over its literals, a byte of
+packed 1 and 0 literals per table lookup
+********************************************/
+double cube_prob(cube_t *cube, input_prob_t *input_prob, int n)
+{
+  int v, w, b;
+  int num_words = NUM_WORDS(n);
+  uint64_t ones, zeros;
+  uint64_t *vector;
+  double prob;
+
+  if(input_prob->num_vector > 0) {
+    prob = 0;
+    for(v = 0; v < input_prob->num_vector; v++) {
+      vector = input_prob->vector + (size_t)v * num_words;
+      for(w = 0; w < num_words; w++)
+	if((vector[w] ^ cube->value[w]) & cube->care[w])
+	  break;
+      if(w == num_words)
+	prob += input_prob->vector_prob[v];
+    }
+    return prob;
+  }
+
+  prob = 1;
+  for(w = 0; w < num_words; w++) {
+    ones = cube->care[w] & cube->value[w];
+    zeros = cube->care[w] & ~cube->value[w];
+    for(b = 8 * w; ones | zeros; b++, ones >>= 8, zeros >>= 8)
+      prob *= input_prob->one_table[b * 256 + (ones & 0xff)] * input_prob->zero_table[b * 256 + (zeros & 0xff)];
+  }
+
+  return prob;
+}
+
+/*******************************************
+pack a code string into num_words words, 
+bit k is set where code[k] is '1'. any other
+character, like an unassigned 'x', is 0
+********************************************/
+void pack_code(char *code, int num_words, uint64_t *bits)
+{
+  int k;
+
+  memset(bits, 0, num_words * sizeof(uint64_t));
+  for(k = 0; code[k] != '\0' && k < num_words * WORD_BITS; k++)
+    if(code[k] == '1')
+      bits[k / WORD_BITS] |= (uint64_t)1 << (k % WORD_BITS);
+}
+
+/*******************************************
+pack the codes of all states into one block
+from the arena of the FSM, reused while the
+code width stays the same. states without a
+code get no packed code
+********************************************/
+boolean pack_fsm_codes(fsm_t *fsm)
+{
+  int i;
+  int max_len = fsm->code_length;
+  int old_words = fsm->code_words;
+
+  for(i = 0; i < fsm->num_state; i++) {
+    fsm->state[i].code_bits = NULL;
+    if(fsm->state[i].code && (int)strlen(fsm->state[i].code) > max_len)
+      max_len = strlen(fsm->state[i].code);
+  }
+
+  fsm->code_words = NUM_WORDS(max_len);
+  if(fsm->num_state == 0 || fsm->code_words == 0)
+    return TRUE;
+
+  if(fsm->code_block && fsm->code_words == old_words)
+    memset(fsm->code_block, 0, (size_t)fsm->num_state * fsm->code_words * sizeof(uint64_t));
+  else
+    fsm->code_block = (uint64_t *)arena_alloc(&fsm->arena, (size_t)fsm->num_state * fsm->code_words * sizeof(uint64_t));
+  if(fsm->code_block == NULL) {
+    pow3_error(POW3_ERR_MEMORY, "ERROR: cannot allocate the packed state codes.\n");
+    return FALSE;
+  }
+
+  for(i = 0; i < fsm->num_state; i++) {
+    if(fsm->state[i].code == NULL)
+      continue;
+    fsm->state[i].code_bits = fsm->code_block + (size_t)i * fsm->code_words;
+    pack_code(fsm->state[i].code, fsm->code_words, fsm->state[i].code_bits);
+  }
+
+  return TRUE;
+}
+
+/*******************************************
+HAMMING distance between two packed codes
+********************************************/
+int hamming_distance_bits(uint64_t *a, uint64_t *b, int num_words)
+{
+  int w;
+  int result = 0;
+
+  for(w = 0; w < num_words; w++)
+    result += POPCOUNT(a[w] ^ b[w]);
+
+  return result;
+}
+
+/*******************************************
+number of bits rising (0->1) from code a to
+code b
+********************************************/
+int rising_bits(uint64_t *a, uint64_t *b, int num_words)
+{
+  int w;
+  int result = 0;
+
+  for(w = 0; w < num_words; w++)
+    result += POPCOUNT(~a[w] & b[w]);
+
+  return result;
+}
+
+/*******************************************
+number of bits falling (1->0) from code a to
+code b
+********************************************/
+int falling_bits(uint64_t *a, uint64_t *b, int num_words)
+{
+  int w;
+  int result = 0;
+
+  for(w = 0; w < num_words; w++)
+    result += POPCOUNT(a[w] & ~b[w]);
+
+  return result;
+}
+
+/*******************************************
+peak switching of a transition from code a
+to code b: the larger of the bits rising
+and the bits falling
+********************************************/
+int switch_bits(uint64_t *a, uint64_t *b, int num_words)
+{
+  int rise = rising_bits(a, b, num_words);
+  int fall = falling_bits(a, b, num_words);
+
+  return rise > fall ? rise : fall;
+}
@@ -1,17 +1,38 @@
 /*************** begin forward function proto declaration *************/
 extern boolean read_fsm_from_blif(char *file_name, fsm_t *fsm);
+extern boolean read_fsm_from_blif_mmap(char *file_name, fsm_t *fsm);
 extern boolean write_fsm_to_blif(char *file_name, fsm_t *fsm);
-extern fsm_t *get_fsm();
-extern void init_fsm();
-extern void free_fsm();
-extern void free_state(state_t *state);
+extern fsm_t *init_fsm();
+extern void free_fsm(fsm_t *fsm);
 extern state_t *add_state(fsm_t *fsm, char *state_name, int i);
+extern boolean set_state_code(fsm_t *fsm, state_t *state, char *code);
+extern boolean set_fsm_code_vector(fsm_t *fsm, int *code_vector);
+extern boolean get_fsm_code_vector(fsm_t *fsm, int *code_vector);
 extern boolean get_state(fsm_t *fsm, char *state_name, state_t **state);
 extern trans_t *add_state_transition(fsm_t *fsm, char *input_str, state_t *current_state, state_t *next_state, char *output_str, int i);
-extern void free_transition(trans_t *transition);
-extern fsm_t *get_fsm();
 extern char *get_name_without_suffix(char *name, char *suffix);
-extern void set_fsm_name(fsm_t *fsm, char *name);
-extern void set_fsm_init_state(fsm_t *fsm, char *state_name);
+extern boolean set_fsm_name(fsm_t *fsm, char *name);
+extern boolean set_fsm_prob_file(fsm_t *fsm, char *file_name);
+extern boolean set_fsm_init_state(fsm_t *fsm, char *state_name);
 extern state_t *get_fsm_init_state(fsm_t *fsm, int *success_flag);
+extern void init_state_hash(fsm_t *fsm, int num_state);
+extern boolean read_input_prob(char *file_name, fsm_t *fsm);
 /*************** end forward function proto declaration **************/
+/*************** begin cube function proto declaration ****************/
+extern void encode_cube(char *str, int n, cube_t *cube);
+extern boolean build_fsm_cubes(fsm_t *fsm);
+extern int cube_num_dontcare(cube_t *cube, int n);
+extern boolean cube_is_care(cube_t *cube, int k);
+extern char cube_literal(cube_t *cube, int k);
+extern boolean cube_intersect(cube_t *a, cube_t *b, int n);
+extern boolean cube_equal(cube_t *a, cube_t *b, int n);
+extern boolean set_input_prob(fsm_t *fsm, double *one);
+extern boolean set_input_vectors(fsm_t *fsm, int num_vector, uint64_t *vector, double *weight);
+extern double cube_prob(cube_t *cube, input_prob_t *input_prob, int n);
+extern void pack_code(char *code, int num_words, uint64_t *bits);
+extern boolean pack_fsm_codes(fsm_t *fsm);
+extern int hamming_distance_bits(uint64_t *a, uint64_t *b, int num_words);
+extern int rising_bits(uint64_t *a, uint64_t *b, int num_words);
+extern int falling_bits(uint64_t *a, uint64_t *b, int num_words);
+extern int switch_bits(uint64_t *a, uint64_t *b, int num_words);
+/*************** end cube function proto declaration ******************/
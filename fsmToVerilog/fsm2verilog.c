@@ -7,14 +7,15 @@
 #include "fsm.h"
 
 // global variables
-extern fsm_t *_kiss_fsm;
 
 /* write fsm to verilog file */
 void write_verilog(fsm_t *fsm)
 {
   FILE *fp_output = NULL;
   char file_name[64] = "\0";
-  int i,j,k;
+  int i,j,k,t;
+  int *trans_order = NULL;
+  int *first_trans = NULL;
   int code_len = fsm->code_length;
   int count = 0;
   int dummy = 0;
@@ -59,15 +60,27 @@ void write_verilog(fsm_t *fsm)
   fprintf(fp_output, "%6cend\n", ' ');
   fprintf(fp_output, "\n");
 
+  // group the transitions by current state, keeping their order in the file
+  first_trans = (int *)calloc(fsm->num_state + 1, sizeof(int));
+  trans_order = (int *)malloc(fsm->num_transition * sizeof(int));
+  for(j = 0; j < fsm->num_transition; j++)
+    first_trans[(fsm->transition[j].current_state)->index + 1]++;
+  for(i = 0; i < fsm->num_state; i++)
+    first_trans[i + 1] += first_trans[i];
+  for(j = 0; j < fsm->num_transition; j++)
+    trans_order[first_trans[(fsm->transition[j].current_state)->index]++] = j;
+  for(i = fsm->num_state; i > 0; i--)
+    first_trans[i] = first_trans[i - 1];
+  first_trans[0] = 0;
+
   // print the combinational logic of next state and output
   fprintf(fp_output, "%6calways@(current_state or data_in) begin\n", ' ');
   fprintf(fp_output, "%8ccase(current_state)\n", ' ');  
   for(i = 0; i < fsm->num_state; i++) { 
     count = 0;
     fprintf(fp_output, "%10cS_%s: begin\n", ' ', fsm->state[i].name);
-    for(j = 0; j < fsm->num_transition; j++) {
-      if(strcmp((fsm->transition[j].current_state)->name, fsm->state[i].name))
-	continue;
+    for(t = first_trans[i]; t < first_trans[i + 1]; t++) {
+      j = trans_order[t];
       if(count == 0) {
 	fprintf(fp_output, "%20cif(", ' ');
 	count ++;
@@ -76,12 +89,12 @@ void write_verilog(fsm_t *fsm)
 	fprintf(fp_output, "%20celse if(", ' ');
 
       input_flag = FALSE;
-      if(strchr(fsm->transition[j].input, '-')) {
+      if(cube_num_dontcare(&fsm->transition[j].in_cube, fsm->num_input) > 0) {
 	for(k = 0; k < fsm->num_input; k++) {
-	  if(isdigit(fsm->transition[j].input[k])) {
+	  if(cube_is_care(&fsm->transition[j].in_cube, k)) {
 	    if(input_flag == TRUE)
 	      fprintf(fp_output, " && ");
-	    fprintf(fp_output, "data_in[%d] == 1'b%c", fsm->num_input - k - 1, fsm->transition[j].input[k]);
+	    fprintf(fp_output, "data_in[%d] == 1'b%c", fsm->num_input - k - 1, cube_literal(&fsm->transition[j].in_cube, k));
 	    input_flag = TRUE;
 	  }
 	}
@@ -97,8 +110,8 @@ void write_verilog(fsm_t *fsm)
       fprintf(fp_output, "%24cnext_state = S_%s;\n", ' ', (fsm->transition[j].next_state)->name);
       fprintf(fp_output, "%24cdata_out = %d'b", ' ', fsm->num_output);
       for(k = 0; k < fsm->num_output; k ++) {
-	if(isdigit(fsm->transition[j].output[k]))
-	  fprintf(fp_output, "%c",fsm->transition[j].output[k]);
+	if(cube_is_care(&fsm->transition[j].out_cube, k))
+	  fprintf(fp_output, "%c", cube_literal(&fsm->transition[j].out_cube, k));
 	else
 	  fprintf(fp_output, "x");
       }
@@ -123,6 +136,9 @@ void write_verilog(fsm_t *fsm)
   fprintf(fp_output, "%6cend\n", ' ');
   fprintf(fp_output, "endmodule\n");
   fclose(fp_output);
+
+  free(first_trans);
+  free(trans_order);
 }
 
 /* write the test bench for FSM */
@@ -195,17 +211,17 @@ int main(int argc, char **argv)
 
   infile_name = argv[1];
   
-  init_fsm();  
-  fsm = get_fsm();
+  fsm = init_fsm();
 
-  if(read_fsm_from_blif(infile_name, fsm) == FALSE) {
+  if(read_fsm_from_blif_mmap(infile_name, fsm) == FALSE) {
     printf("ERROR: Unable to read FSM from the input blif file.\n");
-    free_fsm();
+    free_fsm(fsm);
     exit(1);
   }
 
   print_fsm(fsm);
   write_verilog(fsm);
   write_testbench(fsm);
+  free_fsm(fsm);
   return 0;
 }
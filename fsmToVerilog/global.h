@@ -14,4 +14,20 @@
 #define SHORT_STRING_LEN    64
 #define LONG_STRING_LEN     1024
 
+// packed bit vectors
+#define WORD_BITS           64
+#define NUM_WORDS(n)        (((n) + WORD_BITS - 1) / WORD_BITS)
+#define POPCOUNT(x)         __builtin_popcountll(x)
+
+// steady state solvers for the Markov chain model
+#define STEADY_SPARSE       0
+#define STEADY_DENSE        1
+#define STEADY_TOLERANCE    1.0e-12
+#define STEADY_MAX_ITER     100000
+#define STEADY_RESIDUAL     1.0e-9   // largest |pi P - pi| accepted by the dense solve
+
+// formats of the total transition probability files
+#define PROB_TEXT           0        // <fsm>.prob, n x n table of %.4f
+#define PROB_BINARY         1        // <fsm>.bprob, sparse, see csr_file_header_t
+
 #endif
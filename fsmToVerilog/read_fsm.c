@@ -2,108 +2,212 @@
 #include <stdlib.h>
 #include <math.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "struct.h"
 #include "global.h"
-
-// global variables 
-fsm_t *_kiss_fsm;
+#include "context.h"
+#include "fsm.h"
 
 /*************** begin forward function proto declaration *************/
 boolean read_fsm_from_blif(char *file_name, fsm_t *fsm);
-fsm_t *get_fsm();
-void init_fsm();
-void free_fsm();
-void free_state(state_t *state);
+boolean read_fsm_from_blif_mmap(char *file_name, fsm_t *fsm);
+fsm_t *init_fsm();
+void free_fsm(fsm_t *fsm);
 state_t *add_state(fsm_t *fsm, char *state_name, int i);
+boolean set_fsm_code_vector(fsm_t *fsm, int *code_vector);
+boolean get_fsm_code_vector(fsm_t *fsm, int *code_vector);
 boolean get_state(fsm_t *fsm, char *state_name, state_t **state);
 trans_t *add_state_transition(fsm_t *fsm, char *input_str, state_t *current_state, state_t *next_state, char *output_str, int i);
-void free_transition(trans_t *transition);
-fsm_t *get_fsm();
 char *get_name_without_suffix(char *name, char *suffix);
-void set_fsm_name(fsm_t *fsm, char *name);
-void set_fsm_init_state(fsm_t *fsm, char *state_name);
+boolean set_fsm_name(fsm_t *fsm, char *name);
+boolean set_fsm_prob_file(fsm_t *fsm, char *file_name);
+boolean set_fsm_init_state(fsm_t *fsm, char *state_name);
 state_t *get_fsm_init_state(fsm_t *fsm, int *success_flag);
+void init_state_hash(fsm_t *fsm, int num_state);
+boolean read_input_prob(char *file_name, fsm_t *fsm);
 /*************** end forward function proto declaration **************/
 
-void init_fsm()
+/**********************************
+a new empty FSM, owned by the
+caller and freed with free_fsm().
+the FSM and all its data live in
+its arena
+**********************************/
+fsm_t *init_fsm()
 {
-  _kiss_fsm = (fsm_t *)malloc(sizeof(fsm_t));
-  _kiss_fsm->name = NULL;
-  _kiss_fsm->init_state = NULL;
-  _kiss_fsm->num_input = 0;
-  _kiss_fsm->num_output = 0;
-  _kiss_fsm->num_transition = 0;
-  _kiss_fsm->num_state = 0;
-  _kiss_fsm->code_length = 0;
-  _kiss_fsm->state = NULL;
-  _kiss_fsm->transition = NULL;
+  pow3_arena_t arena;
+  fsm_t *fsm = NULL;
+
+  init_arena(&arena, ARENA_BLOCK_SIZE);
+  if((fsm = (fsm_t *)arena_alloc(&arena, sizeof(fsm_t))) == NULL)
+    return NULL;
+
+  fsm->name = NULL;
+  fsm->init_state = NULL;
+  fsm->num_input = 0;
+  fsm->num_output = 0;
+  fsm->num_transition = 0;
+  fsm->num_state = 0;
+  fsm->code_length = 0;
+  fsm->hash_size = 0;
+  fsm->state_hash = NULL;
+  fsm->cube_words = NULL;
+  fsm->code_words = 0;
+  fsm->code_block = NULL;
+  fsm->state = NULL;
+  fsm->transition = NULL;
+  fsm->input_prob = NULL;
+  fsm->prob_file = NULL;
+  fsm->arena = arena;
+
+  return fsm;
 }
 
-void free_fsm()
+/**********************************
+the FSM goes away with its arena
+**********************************/
+void free_fsm(fsm_t *fsm)
 {
-  int i;
-
-  if(_kiss_fsm->name) 
-    free(_kiss_fsm->name);
+  pow3_arena_t arena;
 
-  if(_kiss_fsm->init_state)
-    free(_kiss_fsm->init_state);
+  if(fsm == NULL)
+    return;
 
-  if(_kiss_fsm->state) {
-    for(i = 0; i < _kiss_fsm->num_state; i++) {
-      free_state(&_kiss_fsm->state[i]);
-    }
-    _kiss_fsm->state = NULL;
+  arena = fsm->arena;
+  if(fsm->input_prob && fsm->input_prob->max_vector > 0) {
+    arena.allocator.free(fsm->input_prob->vector, arena.allocator.user);
+    arena.allocator.free(fsm->input_prob->vector_prob, arena.allocator.user);
   }
+  free_arena(&arena);
+}
 
-  if(_kiss_fsm->transition) {
-    for(i = 0; i < _kiss_fsm->num_transition; i++) {
-      free_transition(&_kiss_fsm->transition[i]);
-    }
-    _kiss_fsm->transition = NULL;
+/*******************************************************
+  string hash of a state name (FNV-1a)
+*******************************************************/
+unsigned int hash_state_name(char *name)
+{
+  unsigned int h = 2166136261u;
+
+  while(*name) {
+    h ^= (unsigned char)*name++;
+    h *= 16777619u;
   }
+  return h;
+}
 
-  _kiss_fsm->num_input = 0;
-  _kiss_fsm->num_output = 0;
-  _kiss_fsm->num_transition = 0;
-  _kiss_fsm->num_state = 0;
-  _kiss_fsm->code_length = 0;
-    
-  free(_kiss_fsm);
+/*******************************************************
+  allocate an empty name to index table for num_state 
+  states, called once the .s line is known
+*******************************************************/
+void init_state_hash(fsm_t *fsm, int num_state)
+{
+  int i;
+
+  fsm->hash_size = 16;
+  while(fsm->hash_size < 2 * num_state)
+    fsm->hash_size <<= 1;
+
+  fsm->state_hash = (int *)arena_alloc(&fsm->arena, fsm->hash_size * sizeof(int));
+  for(i = 0; fsm->state_hash && i < fsm->hash_size; i++)
+    fsm->state_hash[i] = UNDEFINE;
 }
 
-void free_state(state_t *state)
+/*******************************************************
+  return the table slot holding state_name, or the 
+  empty slot where it would be inserted
+*******************************************************/
+int find_state_slot(fsm_t *fsm, char *state_name)
 {
-  state->index = 0;
-  if(state->name)
-    free(state->name);
-  if(state->code) {
-    free(state->code);
-    state->code = NULL;
+  int mask = fsm->hash_size - 1;
+  int slot = hash_state_name(state_name) & mask;
+  int index;
+
+  while((index = fsm->state_hash[slot]) != UNDEFINE) {
+    if(fsm->state[index].name && !strcmp(fsm->state[index].name, state_name))
+      break;
+    slot = (slot + 1) & mask;
   }
+  return slot;
 }
 
 state_t *add_state(fsm_t *fsm, char *state_name, int i)
 {
   if(i >= fsm->num_state) {
-    printf("ERROR: adding state %s exceeds the number of states %d.\n", state_name, fsm->num_state);
+    pow3_error(POW3_ERR_PARSE, "ERROR: adding state %s exceeds the number of states %d.\n", state_name, fsm->num_state);
     return NULL;
   }
-  
-  free_state(&fsm->state[i]);
+
   fsm->state[i].index = i;
-  fsm->state[i].name = (char *)calloc(strlen(state_name) + 1, sizeof(char));
-  strcpy(fsm->state[i].name, state_name);
+  if((fsm->state[i].name = arena_strdup(&fsm->arena, state_name)) == NULL)
+    return NULL;
+
+  if(fsm->state_hash)
+    fsm->state_hash[find_state_slot(fsm, state_name)] = i;
 
   return &(fsm->state[i]);
 }
 
-void set_state_code(state_t *state, char *code)
+/*******************************************************
+  a code of the same length is copied over the old one,
+  else the new code is taken from the arena. FALSE if
+  it is out of memory
+*******************************************************/
+boolean set_state_code(fsm_t *fsm, state_t *state, char *code)
+{
+  if(state->code && strlen(state->code) == strlen(code)) {
+    strcpy(state->code, code);
+    return TRUE;
+  }
+  return (state->code = arena_strdup(&fsm->arena, code)) != NULL;
+}
+
+/*******************************************************
+  write integer codes back to the FSM states, bit k of
+  code_vector[i] is character k of the code of state i
+*******************************************************/
+boolean set_fsm_code_vector(fsm_t *fsm, int *code_vector)
+{
+  int i, k;
+  char *code = NULL;
+
+  if((code = (char *)pow3_calloc(fsm->code_length + 1, sizeof(char))) == NULL) {
+    pow3_error(POW3_ERR_MEMORY, "ERROR: cannot allocate a state code.\n");
+    return FALSE;
+  }
+  for(i = 0; i < fsm->num_state; i++) {
+    for(k = 0; k < fsm->code_length; k++)
+      code[k] = ((code_vector[i] >> k) & 1) ? '1' : '0';
+    if(set_state_code(fsm, &fsm->state[i], code) == FALSE) {
+      pow3_free(code);
+      return FALSE;
+    }
+  }
+  pow3_free(code);
+
+  return pack_fsm_codes(fsm);
+}
+
+/*******************************************************
+  read the codes of the FSM states as integers, FALSE
+  if some state has no complete code
+*******************************************************/
+boolean get_fsm_code_vector(fsm_t *fsm, int *code_vector)
 {
-  if(state->code)
-    free(state->code);
-  state->code = (char *)calloc(strlen(code) + 1, sizeof(char));
-  strcpy(state->code, code);
+  int i, k;
+
+  for(i = 0; i < fsm->num_state; i++) {
+    if(fsm->state[i].code == NULL || (int)strlen(fsm->state[i].code) < fsm->code_length)
+      return FALSE;
+    code_vector[i] = 0;
+    for(k = 0; k < fsm->code_length; k++)
+      if(fsm->state[i].code[k] == '1')
+	code_vector[i] |= 1 << k;
+  }
+
+  return TRUE;
 }
 
 boolean get_state(fsm_t *fsm, char *state_name, state_t **state)
@@ -114,6 +218,14 @@ boolean get_state(fsm_t *fsm, char *state_name, state_t **state)
   if(state_name == NULL)
     return FALSE;
 
+  if(fsm->state_hash) {
+    i = fsm->state_hash[find_state_slot(fsm, state_name)];
+    if(i == UNDEFINE)
+      return FALSE;
+    *state = &fsm->state[i];
+    return TRUE;
+  }
+
   for(i = 0; i < fsm->num_state; i++) {
     if(fsm->state[i].name == NULL)
       continue;
@@ -130,57 +242,48 @@ boolean get_state(fsm_t *fsm, char *state_name, state_t **state)
 trans_t *add_state_transition(fsm_t *fsm, char *input_string, state_t *current_state, state_t *next_state, char *output_string, int i)
 {
   if(i >= fsm->num_transition) {
-    printf("ERROR: state transition counter exceeds the number of transitions.\n");
+    pow3_error(POW3_ERR_PARSE, "ERROR: state transition counter exceeds the number of transitions.\n");
     return NULL;
   }
 
-  fsm->transition[i].input = (char *)calloc(strlen(input_string) + 1, sizeof(char));
-  strcpy(fsm->transition[i].input, input_string);
-  fsm->transition[i].output = (char *)calloc(strlen(output_string) + 1, sizeof(char));
-  strcpy(fsm->transition[i].output, output_string);
+  fsm->transition[i].index = i;
+  fsm->transition[i].input = arena_strdup(&fsm->arena, input_string);
+  fsm->transition[i].output = arena_strdup(&fsm->arena, output_string);
+  if(fsm->transition[i].input == NULL || fsm->transition[i].output == NULL)
+    return NULL;
   fsm->transition[i].current_state = current_state;
   fsm->transition[i].next_state = next_state;
 
   return &(fsm->transition[i]);
 }
 
-void free_transition(trans_t *transition)
+boolean set_fsm_name(fsm_t *fsm, char *name)
 {
-  if(transition->input)
-    free(transition->input);
-
-  if(transition->output)
-    free(transition->output);
-
-  transition->current_state = NULL;
-  transition->next_state = NULL;
-}
-
-fsm_t *get_fsm()
-{
-  return _kiss_fsm;
+  if(fsm == NULL || name == NULL)
+    return FALSE;
+  return (fsm->name = arena_strdup(&fsm->arena, name)) != NULL;
 }
 
-void set_fsm_name(fsm_t *fsm, char *name)
+/**********************************
+take the total transition
+probabilities of the FSM from a
+.prob or .bprob file instead of the
+Markov chain of its STG, NULL goes
+back to the STG
+**********************************/
+boolean set_fsm_prob_file(fsm_t *fsm, char *file_name)
 {
-  if(fsm) {
-    if(fsm->name)
-      free(fsm->name);
-    
-    fsm->name = (char *)calloc(strlen(name) + 1, sizeof(char));
-    strcpy(fsm->name, name);
-  }
+  if(fsm == NULL)
+    return FALSE;
+  fsm->prob_file = file_name ? arena_strdup(&fsm->arena, file_name) : NULL;
+  return file_name == NULL || fsm->prob_file != NULL;
 }
 
-void set_fsm_init_state(fsm_t *fsm, char *state_name)
+boolean set_fsm_init_state(fsm_t *fsm, char *state_name)
 {
-  if(fsm && state_name) {
-    if(fsm->init_state)
-      free(fsm->init_state);
-
-    fsm->init_state = (char *)calloc(strlen(state_name) + 1, sizeof(char));
-    strcpy(fsm->init_state, state_name);
-  }
+  if(fsm == NULL || state_name == NULL)
+    return FALSE;
+  return (fsm->init_state = arena_strdup(&fsm->arena, state_name)) != NULL;
 }
 
 state_t *get_fsm_init_state(fsm_t *fsm, int *success_flag) 
@@ -203,7 +306,7 @@ state_t *get_fsm_init_state(fsm_t *fsm, int *success_flag)
 /*******************************************************
   strip the suffix from original name and return 
   the new name. caller's responsibility to free 
-  the new name.
+  the new name. NULL if out of memory
 *******************************************************/
 char *get_name_without_suffix(char *name, char *suffix)
 {
@@ -214,7 +317,8 @@ char *get_name_without_suffix(char *name, char *suffix)
   if(name == NULL || suffix == NULL)
     return NULL;
 
-  new_name = (char *)calloc(strlen(name) + 1, sizeof(char));
+  if((new_name = (char *)pow3_calloc(strlen(name) + 1, sizeof(char))) == NULL)
+    return NULL;
   strcpy(new_name, name);
   name_len = strlen(name); 
   suffix_len = strlen(suffix);
@@ -230,8 +334,8 @@ char *get_name_without_suffix(char *name, char *suffix)
 boolean read_fsm_from_blif(char *file_name, fsm_t *fsm)
 {
   FILE *fp_input = NULL;
-  static int state_count = 0;
-  static int trans_count = 0;
+  int state_count = 0;
+  int trans_count = 0;
   char value[64];
   char tag[16];
   char input_str[64];
@@ -246,7 +350,7 @@ boolean read_fsm_from_blif(char *file_name, fsm_t *fsm)
   trans_t *transition = NULL;
 
   if((fp_input = fopen(file_name, "r")) == NULL) {
-    printf("ERROR: Cannot open input file %s\n", file_name);
+    pow3_error(POW3_ERR_IO, "ERROR: Cannot open input file %s\n", file_name);
     return FALSE;
   }
 
@@ -255,10 +359,13 @@ boolean read_fsm_from_blif(char *file_name, fsm_t *fsm)
   else
     temp_name = get_name_without_suffix(file_name, ".blif");
 
-  set_fsm_name(fsm, temp_name);
-  free(temp_name);
+  if(temp_name == NULL || set_fsm_name(fsm, temp_name) == FALSE) {
+    pow3_free(temp_name);
+    goto failure;
+  }
+  pow3_free(temp_name);
 
-  printf("Reading FSM %s...\n", fsm->name);
+  pow3_log("Reading FSM %s...\n", fsm->name);
 
   while(fgets(line, 1024, fp_input) != NULL) {
     if(line[0] == ' ' || line[0] == '\n')
@@ -273,14 +380,19 @@ boolean read_fsm_from_blif(char *file_name, fsm_t *fsm)
 	fsm->num_output = atoi(value);
       else if(!strcmp(tag, ".s")) {
 	fsm->num_state = atoi(value);
-	fsm->state = (state_t *)calloc(atoi(value), sizeof(state_t));
+	fsm->state = (state_t *)arena_alloc(&fsm->arena, fsm->num_state * sizeof(state_t));
+	init_state_hash(fsm, fsm->num_state);
+	if(fsm->state == NULL || fsm->state_hash == NULL)
+	  goto failure;
       }
       else if(!strcmp(tag, ".p")) {
 	fsm->num_transition = atoi(value);
-	fsm->transition = (trans_t *)calloc(atoi(value), sizeof(trans_t));
+	if((fsm->transition = (trans_t *)arena_alloc(&fsm->arena, fsm->num_transition * sizeof(trans_t))) == NULL)
+	  goto failure;
       }
       else if(!strcmp(tag, ".r")) {
-	set_fsm_init_state(fsm, value);
+	if(set_fsm_init_state(fsm, value) == FALSE)
+	  goto failure;
       }
       else if(!strcmp(tag, ".end")) {
 	break;
@@ -288,45 +400,442 @@ boolean read_fsm_from_blif(char *file_name, fsm_t *fsm)
       else if(!strcmp(tag, ".code")) {
 	sscanf(line, "%s %s %s", tag, cstate_str, code_str);
 	if(get_state(fsm, cstate_str, &current_state) == FALSE) {
-	  printf("ERROR: cannot find state %s in the FSM.\n");
-	  return FALSE;
+	  pow3_error(POW3_ERR_PARSE, "ERROR: cannot find state %s in the FSM.\n", cstate_str);
+	  goto failure;
 	}
 
-	set_state_code(current_state, code_str);
+	if(set_state_code(fsm, current_state, code_str) == FALSE)
+	  goto failure;
       }
       else {
-	printf("ERROR: Incorrect in line %s\n", line);
-	return FALSE;
+	pow3_error(POW3_ERR_PARSE, "ERROR: Incorrect in line %s\n", line);
+	goto failure;
       }
     
     }
     else {
       if(sscanf(line, "%s %s %s %s", input_str, cstate_str, nstate_str, output_str) != 4) {
-	printf("ERROR: Incorrect in line %s\n", line);
-	return FALSE;
+	pow3_error(POW3_ERR_PARSE, "ERROR: Incorrect in line %s\n", line);
+	goto failure;
       }
 
       if(get_state(fsm, cstate_str, &current_state) == FALSE) {
 	current_state = add_state(fsm, cstate_str, state_count++);
 	if(current_state == NULL)
-	  return FALSE;
+	  goto failure;
       }
 
       if(get_state(fsm, nstate_str, &next_state) == FALSE) {
 	next_state = add_state(fsm, nstate_str, state_count++);
 	if(next_state == NULL)
-	  return FALSE;
+	  goto failure;
       }
 
       transition = add_state_transition(fsm, input_str, current_state, next_state, output_str, trans_count++);
+      if(transition == NULL)
+	goto failure;
     }  
   }
+  fclose(fp_input);
 
   double temp = log2((double)fsm->num_state);
   // make sure there is no rounding up due to precision
   fsm->code_length = ceil(temp);
 
-  return TRUE;
+  return build_fsm_cubes(fsm) && pack_fsm_codes(fsm);
+
+ failure:
+  fclose(fp_input);
+  return FALSE;
+}
+
+/*******************************************************
+  split [begin, end) into at most max_tok whitespace
+  separated tokens, return the number of tokens
+*******************************************************/
+int split_tokens(char *begin, char *end, char **tok, int *tok_len, int max_tok)
+{
+  int num_tok = 0;
+  char *p = begin;
+
+  while(p < end && num_tok < max_tok) {
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+      p++;
+    if(p == end)
+      break;
+    tok[num_tok] = p;
+    while(p < end && *p != ' ' && *p != '\t' && *p != '\r')
+      p++;
+    tok_len[num_tok] = p - tok[num_tok];
+    num_tok++;
+  }
+
+  return num_tok;
+}
+
+boolean token_equal(char *tok, int len, char *str)
+{
+  return (int)strlen(str) == len && !strncmp(tok, str, len);
+}
+
+int token_to_int(char *tok, int len)
+{
+  int value = 0;
+  int i;
+
+  for(i = 0; i < len && tok[i] >= '0' && tok[i] <= '9'; i++)
+    value = value * 10 + (tok[i] - '0');
+  return value;
+}
+
+/*******************************************************
+  copy a token to the top of the string arena as a C 
+  string. the arena top only moves if keep is TRUE, 
+  otherwise the copy is scratch space for lookups
+*******************************************************/
+char *arena_string(char **top, char *tok, int len, boolean keep)
+{
+  char *str = *top;
+
+  memcpy(str, tok, len);
+  str[len] = '\0';
+  if(keep)
+    *top += len + 1;
+  return str;
+}
+
+/*******************************************************
+  look up a state by name, appending it to the FSM 
+  when it is new. the name lives in the string arena
+*******************************************************/
+state_t *intern_state(fsm_t *fsm, char **top, char *tok, int len, int *state_count)
+{
+  char *name = arena_string(top, tok, len, FALSE);
+  int slot = find_state_slot(fsm, name);
+  int i = fsm->state_hash[slot];
+
+  if(i != UNDEFINE)
+    return &fsm->state[i];
+
+  if(*state_count >= fsm->num_state) {
+    pow3_error(POW3_ERR_PARSE, "ERROR: adding state %s exceeds the number of states %d.\n", name, fsm->num_state);
+    return NULL;
+  }
+
+  i = (*state_count)++;
+  fsm->state[i].index = i;
+  fsm->state[i].name = arena_string(top, tok, len, TRUE);
+  fsm->state_hash[slot] = i;
+
+  return &fsm->state[i];
+}
+
+/*******************************************************
+  read in fsm from a memory mapped file. tokens are 
+  cut straight out of the mapping and all state names
+  and cubes are copied into one string arena owned by
+  the FSM, so there is no limit on the cube width and
+  no allocation per field
+*******************************************************/
+boolean read_fsm_from_blif_mmap(char *file_name, fsm_t *fsm)
+{
+  int fd = -1;
+  struct stat file_stat;
+  char *map = NULL;
+  char *end, *p, *line_end;
+  char *top = NULL;
+  char *tok[4];
+  int tok_len[4];
+  int num_tok;
+  int state_count = 0;
+  int trans_count = 0;
+  char *temp_name = NULL;
+  state_t *current_state = NULL;
+  state_t *next_state = NULL;
+  trans_t *transition = NULL;
+  boolean ret_flag = FALSE;
+
+  if((fd = open(file_name, O_RDONLY)) < 0 || fstat(fd, &file_stat) < 0) {
+    pow3_error(POW3_ERR_IO, "ERROR: Cannot open input file %s\n", file_name);
+    if(fd >= 0)
+      close(fd);
+    return FALSE;
+  }
+
+  if(file_stat.st_size > 0) {
+    map = (char *)mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED) {
+      pow3_error(POW3_ERR_IO, "ERROR: Cannot map input file %s\n", file_name);
+      close(fd);
+      return FALSE;
+    }
+  }
+  end = map + file_stat.st_size;
+
+  if(strstr(file_name, ".kiss2"))
+    temp_name = get_name_without_suffix(file_name, ".kiss2");
+  else
+    temp_name = get_name_without_suffix(file_name, ".blif");
+
+  if(temp_name == NULL || set_fsm_name(fsm, temp_name) == FALSE) {
+    pow3_free(temp_name);
+    goto failure;
+  }
+  pow3_free(temp_name);
+
+  pow3_log("Reading FSM %s...\n", fsm->name);
+
+  // every stored token is followed by a separator in the file,
+  // so all of them fit in one string block of the file size
+  if((top = (char *)arena_alloc(&fsm->arena, file_stat.st_size + 1)) == NULL)
+    goto failure;
+
+  for(p = map; p < end; p = line_end + 1) {
+    if((line_end = (char *)memchr(p, '\n', end - p)) == NULL)
+      line_end = end;
+    if(p == line_end || *p == ' ')
+      continue;
+
+    num_tok = split_tokens(p, line_end, tok, tok_len, 4);
+    if(num_tok == 0)
+      continue;
+
+    if(*p == '.') {
+      if(token_equal(tok[0], tok_len[0], ".model") || token_equal(tok[0], tok_len[0], ".start_kiss") || token_equal(tok[0], tok_len[0], ".end_kiss"))
+	continue;
+      else if(token_equal(tok[0], tok_len[0], ".end"))
+	break;
+      else if(num_tok < 2) {
+	pow3_error(POW3_ERR_PARSE, "ERROR: Incorrect in line %.*s\n", (int)(line_end - p), p);
+	goto failure;
+      }
+      else if(token_equal(tok[0], tok_len[0], ".i"))
+	fsm->num_input = token_to_int(tok[1], tok_len[1]);
+      else if(token_equal(tok[0], tok_len[0], ".o"))
+	fsm->num_output = token_to_int(tok[1], tok_len[1]);
+      else if(token_equal(tok[0], tok_len[0], ".s")) {
+	fsm->num_state = token_to_int(tok[1], tok_len[1]);
+	fsm->state = (state_t *)arena_alloc(&fsm->arena, fsm->num_state * sizeof(state_t));
+	init_state_hash(fsm, fsm->num_state);
+	if(fsm->state == NULL || fsm->state_hash == NULL)
+	  goto failure;
+      }
+      else if(token_equal(tok[0], tok_len[0], ".p")) {
+	fsm->num_transition = token_to_int(tok[1], tok_len[1]);
+	if((fsm->transition = (trans_t *)arena_alloc(&fsm->arena, fsm->num_transition * sizeof(trans_t))) == NULL)
+	  goto failure;
+      }
+      else if(token_equal(tok[0], tok_len[0], ".r")) {
+	if(set_fsm_init_state(fsm, arena_string(&top, tok[1], tok_len[1], FALSE)) == FALSE)
+	  goto failure;
+      }
+      else if(token_equal(tok[0], tok_len[0], ".code") && num_tok >= 3) {
+	if(fsm->state_hash == NULL || get_state(fsm, arena_string(&top, tok[1], tok_len[1], FALSE), &current_state) == FALSE) {
+	  pow3_error(POW3_ERR_PARSE, "ERROR: cannot find state %.*s in the FSM.\n", tok_len[1], tok[1]);
+	  goto failure;
+	}
+	if(set_state_code(fsm, current_state, arena_string(&top, tok[2], tok_len[2], FALSE)) == FALSE)
+	  goto failure;
+      }
+      else {
+	pow3_error(POW3_ERR_PARSE, "ERROR: Incorrect in line %.*s\n", (int)(line_end - p), p);
+	goto failure;
+      }
+    }
+    else {
+      if(num_tok != 4 || fsm->state_hash == NULL) {
+	pow3_error(POW3_ERR_PARSE, "ERROR: Incorrect in line %.*s\n", (int)(line_end - p), p);
+	goto failure;
+      }
+
+      if((current_state = intern_state(fsm, &top, tok[1], tok_len[1], &state_count)) == NULL)
+	goto failure;
+      if((next_state = intern_state(fsm, &top, tok[2], tok_len[2], &state_count)) == NULL)
+	goto failure;
+
+      if(trans_count >= fsm->num_transition) {
+	pow3_error(POW3_ERR_PARSE, "ERROR: state transition counter exceeds the number of transitions.\n");
+	goto failure;
+      }
+      transition = &fsm->transition[trans_count];
+      transition->index = trans_count++;
+      transition->input = arena_string(&top, tok[0], tok_len[0], TRUE);
+      transition->output = arena_string(&top, tok[3], tok_len[3], TRUE);
+      transition->current_state = current_state;
+      transition->next_state = next_state;
+    }
+  }
+
+  double temp = log2((double)fsm->num_state);
+  // make sure there is no rounding up due to precision
+  fsm->code_length = ceil(temp);
+  ret_flag = build_fsm_cubes(fsm) && pack_fsm_codes(fsm);
+
+ failure:
+  if(map)
+    munmap(map, file_stat.st_size);
+  close(fd);
+
+  return ret_flag;
+}
+
+/*******************************************************
+  a token as a double, UNDEFINE if it is not a number
+*******************************************************/
+double token_to_double(char *tok, int len)
+{
+  char num[64];
+  char *num_end;
+  double value;
+
+  if(len <= 0 || len >= (int)sizeof(num))
+    return UNDEFINE;
+  memcpy(num, tok, len);
+  num[len] = '\0';
+  value = strtod(num, &num_end);
+
+  return num_end == num + len ? value : UNDEFINE;
+}
+
+/*******************************************************
+  read the input probabilities of a FSM. the file has
+  either a line ".p p0 p1 ..." of the probability that
+  each input is 1, the inputs independent, or lines
+  "<0/1 input vector> [count]" of an empirical input
+  distribution, like a trace with the vectors counted.
+  an optional ".i" line must match the FSM and text
+  after '#' is a comment
+*******************************************************/
+boolean read_input_prob(char *file_name, fsm_t *fsm)
+{
+  int fd = -1;
+  struct stat file_stat;
+  char *map = NULL;
+  char *end, *p, *line_end, *comment;
+  char **tok = NULL;
+  int *tok_len = NULL;
+  int num_tok, k;
+  int num_input = fsm->num_input;
+  int num_words = NUM_WORDS(num_input);
+  int num_line = 0, num_vector = 0, line = 0;
+  double *one = NULL;
+  double *weight = NULL;
+  uint64_t *vector = NULL;
+  boolean got_one = FALSE;
+  boolean ret_flag = FALSE;
+
+  if((fd = open(file_name, O_RDONLY)) < 0 || fstat(fd, &file_stat) < 0) {
+    pow3_error(POW3_ERR_IO, "ERROR: Cannot open input probability file %s\n", file_name);
+    if(fd >= 0)
+      close(fd);
+    return FALSE;
+  }
+
+  if(file_stat.st_size > 0) {
+    map = (char *)mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED) {
+      pow3_error(POW3_ERR_IO, "ERROR: Cannot map input probability file %s\n", file_name);
+      close(fd);
+      return FALSE;
+    }
+  }
+  end = map + file_stat.st_size;
+
+  // a vector per line at most
+  for(p = map; p < end; p++)
+    if(*p == '\n')
+      num_line++;
+  num_line++;
+
+  tok = (char **)pow3_malloc((num_input + 2) * sizeof(char *));
+  tok_len = (int *)pow3_malloc((num_input + 2) * sizeof(int));
+  one = (double *)pow3_malloc((num_input + 1) * sizeof(double));
+  weight = (double *)pow3_malloc(num_line * sizeof(double));
+  vector = (uint64_t *)pow3_calloc((size_t)num_line * num_words + 1, sizeof(uint64_t));
+  if(tok == NULL || tok_len == NULL || one == NULL || weight == NULL || vector == NULL)
+    goto failure;
+
+  for(p = map; p < end; p = line_end + 1) {
+    if((line_end = (char *)memchr(p, '\n', end - p)) == NULL)
+      line_end = end;
+    line++;
+
+    if((comment = (char *)memchr(p, '#', line_end - p)) == NULL)
+      comment = line_end;
+    num_tok = split_tokens(p, comment, tok, tok_len, num_input + 2);
+    if(num_tok == 0)
+      continue;
+
+    if(token_equal(tok[0], tok_len[0], ".i")) {
+      if(num_tok != 2 || token_to_int(tok[1], tok_len[1]) != num_input) {
+	pow3_error(POW3_ERR_PARSE, "ERROR: %s is for %.*s inputs, FSM %s has %d.\n", file_name, num_tok > 1 ? tok_len[1] : 1, num_tok > 1 ? tok[1] : "?", fsm->name, num_input);
+	goto failure;
+      }
+    }
+    else if(token_equal(tok[0], tok_len[0], ".p")) {
+      if(num_tok != num_input + 1) {
+	pow3_error(POW3_ERR_PARSE, "ERROR: line %d of %s has %d probabilities, %d expected.\n", line, file_name, num_tok - 1, num_input);
+	goto failure;
+      }
+      for(k = 0; k < num_input; k++) {
+	if((one[k] = token_to_double(tok[k + 1], tok_len[k + 1])) == UNDEFINE) {
+	  pow3_error(POW3_ERR_PARSE, "ERROR: Incorrect probability %.*s in line %d of %s.\n", tok_len[k + 1], tok[k + 1], line, file_name);
+	  goto failure;
+	}
+      }
+      got_one = TRUE;
+    }
+    else if(tok[0][0] == '0' || tok[0][0] == '1') {
+      if(tok_len[0] != num_input || num_tok > 2) {
+	pow3_error(POW3_ERR_PARSE, "ERROR: Incorrect input vector in line %d of %s, %d inputs expected.\n", line, file_name, num_input);
+	goto failure;
+      }
+      for(k = 0; k < num_input; k++) {
+	if(tok[0][k] == '1')
+	  vector[(size_t)num_vector * num_words + k / WORD_BITS] |= (uint64_t)1 << (k % WORD_BITS);
+	else if(tok[0][k] != '0') {
+	  pow3_error(POW3_ERR_PARSE, "ERROR: Incorrect character '%c' in line %d of %s.\n", tok[0][k], line, file_name);
+	  goto failure;
+	}
+      }
+      weight[num_vector] = num_tok == 2 ? token_to_double(tok[1], tok_len[1]) : 1;
+      if(weight[num_vector] < 0) {
+	pow3_error(POW3_ERR_PARSE, "ERROR: Incorrect count %.*s in line %d of %s.\n", tok_len[1], tok[1], line, file_name);
+	goto failure;
+      }
+      num_vector++;
+    }
+    else {
+      pow3_error(POW3_ERR_PARSE, "ERROR: Incorrect in line %d of %s: %.*s\n", line, file_name, (int)(comment - p), p);
+      goto failure;
+    }
+  }
+
+  if(got_one && num_vector > 0) {
+    pow3_error(POW3_ERR_PARSE, "ERROR: %s has both input probabilities and input vectors.\n", file_name);
+    goto failure;
+  }
+  if(got_one)
+    ret_flag = set_input_prob(fsm, one);
+  else if(num_vector > 0)
+    ret_flag = set_input_vectors(fsm, num_vector, vector, weight);
+  else
+    pow3_error(POW3_ERR_PARSE, "ERROR: %s has no input probabilities.\n", file_name);
+
+  if(ret_flag)
+    pow3_log("Input probabilities of FSM %s from %s: %s.\n", fsm->name, file_name, got_one ? "independent inputs" : "empirical distribution");
+
+ failure:
+  pow3_free(tok);
+  pow3_free(tok_len);
+  pow3_free(one);
+  pow3_free(weight);
+  pow3_free(vector);
+  if(map)
+    munmap(map, file_stat.st_size);
+  close(fd);
+
+  return ret_flag;
 }
 
 void traverse_fsm(fsm_t *fsm)
@@ -347,7 +856,7 @@ boolean write_fsm_to_blif_by_index(char *file_name, fsm_t *fsm)
   int i, j;
 
   if((fp_output = fopen(file_name, "w")) == NULL) {
-    printf("ERROR: Cannot open output file %s\n", file_name);
+    pow3_error(POW3_ERR_IO, "ERROR: Cannot open output file %s\n", file_name);
     return FALSE;
   }
 
@@ -368,6 +877,7 @@ boolean write_fsm_to_blif_by_index(char *file_name, fsm_t *fsm)
     fprintf(fp_output,".code %d %s\n", fsm->state[i].index, fsm->state[i].code);
   }
   fprintf(fp_output,".end\n");
+  fclose(fp_output);
 
   return TRUE;
 }
@@ -378,7 +888,7 @@ boolean write_fsm_to_blif(char *file_name, fsm_t *fsm)
   int i, j;
 
   if((fp_output = fopen(file_name, "w")) == NULL) {
-    printf("ERROR: Cannot open output file %s\n", file_name);
+    pow3_error(POW3_ERR_IO, "ERROR: Cannot open output file %s\n", file_name);
     return FALSE;
   }
 
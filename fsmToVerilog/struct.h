@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdint.h>
+#include "context.h"
 
 typedef enum {
   FALSE = 0, 
@@ -11,12 +13,42 @@ typedef struct state_struct {
   int index;
   char *name;
   char *code;
+  uint64_t *code_bits; // packed code, bit k is set where code[k] is '1'
 } state_t;
 
+/*********************************
+bit-packed cube, bit k of the 
+masks is position k of the string
+**********************************/
+typedef struct cube_struct {
+  uint64_t *care;   // set where the literal is 0 or 1
+  uint64_t *value;  // set where the literal is 1
+} cube_t;
+
+/*********************************
+distribution of the primary inputs
+in the Markov model: independent
+signal probabilities, or the
+probabilities of the whole input
+vectors seen in a workload
+**********************************/
+typedef struct input_prob_struct {
+  int num_input;
+  double *one;          // probability of 1, per input
+  double *one_table;    // [8 * word + byte][256]: product of one[k] over the
+  double *zero_table;   // inputs k of the byte set in the index, or of 1 - one[k]
+  int num_vector;       // > 0 for an empirical distribution
+  uint64_t *vector;     // packed input vectors, NUM_WORDS(num_input) each
+  double *vector_prob;
+  int max_vector;       // room of vector and vector_prob, kept outside the arena
+} input_prob_t;
+
 typedef struct trans_struct {
   int index;
   char *input;
   char *output;
+  cube_t in_cube;
+  cube_t out_cube;
   state_t *current_state;
   state_t *next_state;
 } trans_t;
@@ -30,8 +62,16 @@ typedef struct fsm_struct {
   int num_w_edge;
   char *name;
   char *init_state;
+  int hash_size;    // power of two, at least twice num_state
+  int *state_hash;  // open addressing table of state indices
+  uint64_t *cube_words; // storage of all the packed transition cubes
+  int code_words;       // words per packed state code
+  uint64_t *code_block; // storage of all the packed state codes
   state_t *state;
   trans_t *transition;
+  input_prob_t *input_prob; // NULL: every input is a fair coin
+  char *prob_file;      // total transition probabilities, NULL: from the STG
+  pow3_arena_t arena;   // holds the FSM itself and all it points to but the input vectors
 } fsm_t;
 
 typedef struct w_edge_struct {
@@ -0,0 +1,167 @@
+/*
+ * Out of memory test of the libpow3 entry points.
+ * The calls are run with an allocator which fails
+ * from its n-th allocation on, for n = 0, 1, ...
+ * until they all get through. Every call must then
+ * return POW3_OK or POW3_ERR_MEMORY, and all the
+ * memory must be given back once the FSM and the
+ * context are freed. The FSM is freed through a
+ * second context, whose allocator must not see it.
+ *
+ * Usage: fault_test <kiss2 file> [prob file]
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "pow3.h"
+
+/**********************************
+allocations counted and failed
+from fail_at on
+**********************************/
+typedef struct fault_alloc_struct {
+  long num_alloc;
+  long fail_at;
+  long num_fail;
+  long live;
+} fault_alloc_t;
+
+void *fault_malloc(size_t size, void *user)
+{
+  fault_alloc_t *fault = (fault_alloc_t *)user;
+  void *ptr;
+
+  if(fault->num_alloc++ >= fault->fail_at) {
+    fault->num_fail++;
+    return NULL;
+  }
+  if((ptr = malloc(size)) != NULL)
+    fault->live++;
+  return ptr;
+}
+
+void *fault_realloc(void *ptr, size_t size, void *user)
+{
+  fault_alloc_t *fault = (fault_alloc_t *)user;
+  void *new_ptr;
+
+  if(fault->num_alloc++ >= fault->fail_at) {
+    fault->num_fail++;
+    return NULL;
+  }
+  if((new_ptr = realloc(ptr, size)) != NULL && ptr == NULL)
+    fault->live++;
+  return new_ptr;
+}
+
+void fault_free(void *ptr, void *user)
+{
+  fault_alloc_t *fault = (fault_alloc_t *)user;
+
+  if(ptr)
+    fault->live--;
+  free(ptr);
+}
+
+/**********************************
+a call must succeed, or fail for
+the memory it was refused
+**********************************/
+int check_call(char *name, int error, fault_alloc_t *fault)
+{
+  if(error == POW3_OK && fault->num_fail == 0)
+    return 0;
+  if(error == POW3_ERR_MEMORY && fault->num_fail > 0)
+    return 1;
+
+  printf("ERROR: %s returned \"%s\" with allocation %ld failing.\n", name, pow3_strerror(error), fault->fail_at);
+  exit(1);
+}
+
+/**********************************
+the calls of one run, until the
+first one out of memory. returns
+whether an allocation was refused
+**********************************/
+int run_calls(char *kiss_file, char *prob_file, fault_alloc_t *fault)
+{
+  pow3_allocator_t allocator = {fault_malloc, fault_realloc, fault_free, NULL};
+  pow3_allocator_t other_allocator = {fault_malloc, fault_realloc, fault_free, NULL};
+  fault_alloc_t other_fault = {0, LONG_MAX, 0, 0};
+  pow3_ctx_t *ctx = NULL;
+  pow3_ctx_t *other_ctx = NULL;
+  pow3_fsm_t *fsm = NULL;
+  double one[64];
+  double switching;
+  int i, stop = 0;
+
+  allocator.user = fault;
+  other_allocator.user = &other_fault;
+  if((other_ctx = pow3_ctx_new(&other_allocator)) == NULL)
+    exit(1);
+  if((ctx = pow3_ctx_new(&allocator)) == NULL) {
+    pow3_ctx_free(other_ctx);
+    return 1;
+  }
+
+  stop = check_call("pow3_read_fsm", pow3_read_fsm(ctx, kiss_file, &fsm), fault);
+  if(!stop)
+    stop = check_call("pow3_encode_fsm", pow3_encode_fsm(ctx, fsm), fault);
+  if(!stop)
+    stop = check_call("pow3_fsm_switching", pow3_fsm_switching(ctx, fsm, &switching), fault);
+  if(!stop) {
+    pow3_ctx_set_steady_method(ctx, POW3_STEADY_DENSE);
+    stop = check_call("pow3_fsm_switching", pow3_fsm_switching(ctx, fsm, &switching), fault);
+  }
+  if(!stop) {
+    for(i = 0; i < 64; i++)
+      one[i] = 0.25;
+    stop = check_call("pow3_set_input_prob", pow3_set_input_prob(ctx, fsm, one), fault);
+  }
+  if(!stop)
+    stop = check_call("pow3_encode_fsm", pow3_encode_fsm(ctx, fsm), fault);
+  if(!stop && prob_file) {
+    pow3_ctx_set_steady_method(ctx, POW3_STEADY_SPARSE);
+    stop = check_call("pow3_set_prob_file", pow3_set_prob_file(ctx, fsm, prob_file), fault);
+    if(!stop)
+      stop = check_call("pow3_encode_fsm", pow3_encode_fsm(ctx, fsm), fault);
+    if(!stop)
+      stop = check_call("pow3_fsm_switching", pow3_fsm_switching(ctx, fsm, &switching), fault);
+  }
+
+  pow3_free_fsm(other_ctx, fsm);
+  pow3_ctx_free(ctx);
+  pow3_ctx_free(other_ctx);
+
+  if(fault->live != 0 || other_fault.live != 0) {
+    printf("ERROR: %ld blocks not freed with allocation %ld failing.\n", fault->live, fault->fail_at);
+    exit(1);
+  }
+
+  return fault->num_fail > 0;
+}
+
+int main(int argc, char **argv)
+{
+  fault_alloc_t fault;
+  long n;
+
+  if(argc < 2) {
+    printf("Usage: %s <kiss2 file> [prob file]\n", argv[0]);
+    exit(1);
+  }
+
+  for(n = 0; ; n++) {
+    fault.num_alloc = 0;
+    fault.fail_at = n;
+    fault.num_fail = 0;
+    fault.live = 0;
+    if(run_calls(argv[1], argc > 2 ? argv[2] : NULL, &fault) == 0)
+      break;
+  }
+
+  printf("%s: %ld allocations, each one failed in turn.\n", argv[1], fault.num_alloc);
+  return 0;
+}
@@ -0,0 +1 @@
+../fsmSwitching/matrix_util.h
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef POW3_H
+#define POW3_H
+
+/*
+ * libpow3: read, POW3 encode and score FSMs inside
+ * another process. Every call runs in the context
+ * given to it: the memory comes from the allocator
+ * of the context, the messages go to its log (none
+ * until pow3_ctx_set_log) and the call returns
+ * POW3_OK or the code of the first error it ran into.
+ * A context is used by one thread at a time; threads
+ * with their own contexts may work concurrently.
+ *
+ */
+
+#include <stdio.h>
+#include "context.h"
+
+// steady state solver, same as STEADY_SPARSE/STEADY_DENSE
+#define POW3_STEADY_SPARSE  0
+#define POW3_STEADY_DENSE   1
+
+typedef struct fsm_struct pow3_fsm_t;
+
+/*************** begin libpow3 function proto declaration *************/
+extern pow3_ctx_t *pow3_ctx_new(pow3_allocator_t *allocator);
+extern void pow3_ctx_free(pow3_ctx_t *ctx);
+extern void pow3_ctx_set_log(pow3_ctx_t *ctx, FILE *log);
+extern int pow3_ctx_set_steady_method(pow3_ctx_t *ctx, int method);
+extern int pow3_ctx_error(pow3_ctx_t *ctx);
+extern const char *pow3_ctx_message(pow3_ctx_t *ctx);
+extern const char *pow3_strerror(int error);
+
+extern int pow3_read_fsm(pow3_ctx_t *ctx, char *file_name, pow3_fsm_t **fsm);
+extern void pow3_free_fsm(pow3_ctx_t *ctx, pow3_fsm_t *fsm);
+extern int pow3_set_input_prob(pow3_ctx_t *ctx, pow3_fsm_t *fsm, double *one);
+extern int pow3_read_input_prob(pow3_ctx_t *ctx, pow3_fsm_t *fsm, char *file_name);
+extern int pow3_set_prob_file(pow3_ctx_t *ctx, pow3_fsm_t *fsm, char *file_name);
+extern int pow3_encode_fsm(pow3_ctx_t *ctx, pow3_fsm_t *fsm);
+extern int pow3_fsm_switching(pow3_ctx_t *ctx, pow3_fsm_t *fsm, double *switching);
+extern int pow3_write_blif(pow3_ctx_t *ctx, pow3_fsm_t *fsm, char *file_name);
+extern const char *pow3_fsm_name(pow3_fsm_t *fsm);
+extern int pow3_fsm_num_state(pow3_fsm_t *fsm);
+extern const char *pow3_fsm_state_code(pow3_fsm_t *fsm, int i);
+/*************** end libpow3 function proto declaration ***************/
+
+#endif
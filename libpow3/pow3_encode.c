@@ -0,0 +1 @@
+../POW3/encode.c
\ No newline at end of file
@@ -0,0 +1,261 @@
+/*
+ * The libpow3 entry points. Each one makes the
+ * context of the caller current for the thread,
+ * runs the FSM routines and gives back the first
+ * error they recorded.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "struct.h"
+#include "global.h"
+#include "fsm.h"
+#include "pow3.h"
+
+extern boolean write_fsm_to_blif_by_index(char *file_name, fsm_t *fsm);
+extern boolean encode_pow3(fsm_t *fsm);
+extern boolean get_switching_activity(fsm_t *fsm, double *total_sw, boolean print_prob);
+
+/*************** begin forward function proto declaration *************/
+int finish_call(pow3_ctx_t *ctx, pow3_ctx_t *prev, boolean success, int error);
+/*************** end forward function proto declaration **************/
+
+const char *_pow3_error_string[] = {
+  "no error",
+  "invalid argument",
+  "out of memory",
+  "input/output error",
+  "parse error",
+  "no steady state",
+  "singular matrix",
+  "encoding failed"
+};
+
+pow3_ctx_t *pow3_ctx_new(pow3_allocator_t *allocator)
+{
+  return new_context(allocator);
+}
+
+void pow3_ctx_free(pow3_ctx_t *ctx)
+{
+  free_context(ctx);
+}
+
+/**********************************
+messages go to log, none if NULL
+**********************************/
+void pow3_ctx_set_log(pow3_ctx_t *ctx, FILE *log)
+{
+  ctx->log = log;
+  ctx->quiet = (log == NULL);
+}
+
+int pow3_ctx_set_steady_method(pow3_ctx_t *ctx, int method)
+{
+  if(method != POW3_STEADY_SPARSE && method != POW3_STEADY_DENSE)
+    return POW3_ERR_ARGUMENT;
+
+  ctx->steady_method = method;
+  return POW3_OK;
+}
+
+int pow3_ctx_error(pow3_ctx_t *ctx)
+{
+  return ctx->error;
+}
+
+const char *pow3_ctx_message(pow3_ctx_t *ctx)
+{
+  return ctx->message[0] ? ctx->message : pow3_strerror(ctx->error);
+}
+
+const char *pow3_strerror(int error)
+{
+  if(error < 0 || error >= (int)(sizeof(_pow3_error_string) / sizeof(_pow3_error_string[0])))
+    return "unknown error";
+  return _pow3_error_string[error];
+}
+
+/**********************************
+leave the context of a call. a
+failure nobody reported gets error
+**********************************/
+int finish_call(pow3_ctx_t *ctx, pow3_ctx_t *prev, boolean success, int error)
+{
+  if(success == FALSE && ctx->error == POW3_OK)
+    ctx->error = error;
+  leave_context(prev);
+
+  return ctx->error;
+}
+
+/**********************************
+read a kiss2 file into a new FSM,
+*fsm is NULL if it fails
+**********************************/
+int pow3_read_fsm(pow3_ctx_t *ctx, char *file_name, pow3_fsm_t **fsm)
+{
+  pow3_ctx_t *prev;
+  fsm_t *new_fsm = NULL;
+  boolean success = FALSE;
+
+  if(ctx == NULL || fsm == NULL || file_name == NULL)
+    return POW3_ERR_ARGUMENT;
+  *fsm = NULL;
+
+  prev = enter_context(ctx);
+  if((new_fsm = init_fsm()) != NULL) {
+    if((success = read_fsm_from_blif_mmap(file_name, new_fsm)) == TRUE)
+      *fsm = new_fsm;
+    else
+      free_fsm(new_fsm);
+  }
+
+  return finish_call(ctx, prev, success, POW3_ERR_PARSE);
+}
+
+/**********************************
+the memory of fsm goes back to the
+allocator of the context that read
+it, whichever ctx frees it
+**********************************/
+void pow3_free_fsm(pow3_ctx_t *ctx, pow3_fsm_t *fsm)
+{
+  pow3_ctx_t *prev;
+
+  if(ctx == NULL || fsm == NULL)
+    return;
+
+  prev = enter_context(ctx);
+  free_fsm(fsm);
+  leave_context(prev);
+}
+
+/**********************************
+probability one[k] that input k is
+1, the inputs independent. encoding
+and switching weight the transitions
+by it from then on
+**********************************/
+int pow3_set_input_prob(pow3_ctx_t *ctx, pow3_fsm_t *fsm, double *one)
+{
+  pow3_ctx_t *prev;
+  boolean success;
+
+  if(ctx == NULL || fsm == NULL || one == NULL)
+    return POW3_ERR_ARGUMENT;
+
+  prev = enter_context(ctx);
+  success = set_input_prob(fsm, one);
+
+  return finish_call(ctx, prev, success, POW3_ERR_ARGUMENT);
+}
+
+/**********************************
+input probabilities from a file,
+see read_input_prob
+**********************************/
+int pow3_read_input_prob(pow3_ctx_t *ctx, pow3_fsm_t *fsm, char *file_name)
+{
+  pow3_ctx_t *prev;
+  boolean success;
+
+  if(ctx == NULL || fsm == NULL || file_name == NULL)
+    return POW3_ERR_ARGUMENT;
+
+  prev = enter_context(ctx);
+  success = read_input_prob(file_name, fsm);
+
+  return finish_call(ctx, prev, success, POW3_ERR_PARSE);
+}
+
+/**********************************
+take the transition probabilities
+from a .prob or .bprob file, NULL
+goes back to the STG. the file is
+read by every later call that
+needs them
+**********************************/
+int pow3_set_prob_file(pow3_ctx_t *ctx, pow3_fsm_t *fsm, char *file_name)
+{
+  pow3_ctx_t *prev;
+  boolean success;
+
+  if(ctx == NULL || fsm == NULL)
+    return POW3_ERR_ARGUMENT;
+
+  prev = enter_context(ctx);
+  success = set_fsm_prob_file(fsm, file_name);
+
+  return finish_call(ctx, prev, success, POW3_ERR_MEMORY);
+}
+
+int pow3_encode_fsm(pow3_ctx_t *ctx, pow3_fsm_t *fsm)
+{
+  pow3_ctx_t *prev;
+  boolean success;
+
+  if(ctx == NULL || fsm == NULL)
+    return POW3_ERR_ARGUMENT;
+
+  prev = enter_context(ctx);
+  success = encode_pow3(fsm);
+
+  return finish_call(ctx, prev, success, POW3_ERR_ENCODE);
+}
+
+/**********************************
+switching activity of the current
+codes, no .prob file is written
+**********************************/
+int pow3_fsm_switching(pow3_ctx_t *ctx, pow3_fsm_t *fsm, double *switching)
+{
+  pow3_ctx_t *prev;
+  boolean success;
+
+  if(ctx == NULL || fsm == NULL || switching == NULL)
+    return POW3_ERR_ARGUMENT;
+
+  prev = enter_context(ctx);
+  *switching = 0;
+  success = get_switching_activity(fsm, switching, FALSE);
+
+  return finish_call(ctx, prev, success, POW3_ERR_MARKOV);
+}
+
+int pow3_write_blif(pow3_ctx_t *ctx, pow3_fsm_t *fsm, char *file_name)
+{
+  pow3_ctx_t *prev;
+  boolean success;
+
+  if(ctx == NULL || fsm == NULL || file_name == NULL)
+    return POW3_ERR_ARGUMENT;
+
+  prev = enter_context(ctx);
+  success = write_fsm_to_blif_by_index(file_name, fsm);
+
+  return finish_call(ctx, prev, success, POW3_ERR_IO);
+}
+
+const char *pow3_fsm_name(pow3_fsm_t *fsm)
+{
+  return fsm->name;
+}
+
+int pow3_fsm_num_state(pow3_fsm_t *fsm)
+{
+  return fsm->num_state;
+}
+
+/**********************************
+code of state i, NULL before it is
+encoded
+**********************************/
+const char *pow3_fsm_state_code(pow3_fsm_t *fsm, int i)
+{
+  if(i < 0 || i >= fsm->num_state)
+    return NULL;
+  return fsm->state[i].code;
+}